@@ -1,1270 +1,408 @@
 #include <iostream>
-#include <vector>
-#include <queue>
-#include <fstream>
 #include <sstream>
+#include <string>
+#include <vector>
 #include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <iterator>
+#include "OsSim.h"
 using namespace std;
+using namespace ossim;
 
-ostringstream logBuffer;
-ostringstream freeListLog;
-
-// -----------------------------------------------------------------------------
-// Process Structure and Constants
-// -----------------------------------------------------------------------------
-
-struct MemBlock
-{
-    int processID;
-    int start;
-    int size;
-    vector<int> content;
-    MemBlock *next;
-};
-
-struct Process
-{
-    int processID;
-    int maxMemoryNeeded;
-    int numInstructions;
-    vector<int> instructions;
-    int startTime = -1;
-    // NEW: save segmented memory blocks so we can free them on termination.
-    vector<MemBlock *> segmentedBlocks;
-};
-
-const int STATE_NEW = 0;
-const int STATE_RUNNING = 1;
-const int STATE_IO_WAITING = 2;
-const int STATE_TERMINATED = 3;
-
-int ioWaitTime = 0;
-
-// -----------------------------------------------------------------------------
-// CPU Clock and Context Switching
-// -----------------------------------------------------------------------------
-void updateClock(int &totalCpuCycles, int increment, const string &reason)
-{
-    totalCpuCycles += increment;
-}
-
-void contextSwitch(int &totalCpuCycles, int contextSwitchTime, const string &reason)
-{
-    updateClock(totalCpuCycles, contextSwitchTime, reason);
-}
-
-// Debug: Print the free list with each block's start and size.
-void printFreeList(MemBlock *list, const string &label, const string &funclabel)
-{
-    cout << "----- " << label << " -----" << endl;
-    cout << "Calling function: " << endl;
-    if (!list)
-    {
-        cout << "Free list is empty." << endl;
-    }
-    else
-    {
-        MemBlock *curr = list;
-        while (curr)
-        {
-            cout << "Block Start: " << curr->start << ", Size: " << curr->size << endl;
-            curr = curr->next;
-        }
-    }
-    cout << "---------------------" << endl;
-}
-
-// -----------------------------------------------------------------------------
-// Process Input Parsing
-// -----------------------------------------------------------------------------
-vector<Process> parseProcesses(int &maxMemory, int &numProcesses,
-                               int &globalCPUAllocated, int &contextSwitchTime)
-{
-    cin >> maxMemory >> globalCPUAllocated >> contextSwitchTime >> numProcesses;
-    vector<Process> processes;
-    processes.reserve(numProcesses);
-
-    for (int p = 0; p < numProcesses; p++)
-    {
-        Process proc;
-        cin >> proc.processID >> proc.maxMemoryNeeded >> proc.numInstructions;
-        proc.instructions.clear();
-        proc.instructions.reserve(proc.numInstructions * 3);
-
-        int instructionsRead = 0;
-        while (instructionsRead < proc.numInstructions)
-        {
-            int opcode;
-            if (!(cin >> opcode))
-                break;
-            proc.instructions.push_back(opcode);
-            instructionsRead++;
-
-            int numOperands = 0;
-            switch (opcode)
-            {
-            case 1:
-                numOperands = 2;
-                break; // compute
-            case 2:
-                numOperands = 1;
-                break; // print
-            case 3:
-                numOperands = 2;
-                break; // store
-            case 4:
-                numOperands = 1;
-                break; // load
-            default:
-                break;
-            }
-            for (int j = 0; j < numOperands; j++)
-            {
-                int operand;
-                if (!(cin >> operand))
-                    break;
-                proc.instructions.push_back(operand);
-            }
-        }
-        processes.push_back(proc);
-    }
-    return processes;
-}
-
-// -----------------------------------------------------------------------------
-// Memory System
-// -----------------------------------------------------------------------------
-
-MemBlock *initDynamicMemory(int maxMemory)
-{
-    MemBlock *head = new MemBlock();
-    head->processID = -1;
-    head->start = 0;
-    head->size = maxMemory;
-    head->next = nullptr;
-    return head;
-}
-
-// Insert a free block in ascending 'start'
-void insertFreeBlock(MemBlock *block, MemBlock *&logicalList)
-{
-    if (!logicalList || block->start < logicalList->start)
-    {
-        block->next = logicalList;
-        logicalList = block;
-        return;
-    }
-    MemBlock *curr = logicalList;
-    while (curr->next && curr->next->start < block->start)
-    {
-        curr = curr->next;
-    }
-    block->next = curr->next;
-    curr->next = block;
-}
-
-// Coalesce adjacent free blocks
-void coalesceFreeList(MemBlock *&logicalList)
-{
-
-    if (!logicalList)
-        return;
-    MemBlock *curr = logicalList;
-
-    while (curr && curr->next)
-    {
-        if (curr->start + curr->size == curr->next->start)
-        {
-            MemBlock *temp = curr->next;
-            curr->size += temp->size;
-            curr->next = temp->next;
-            delete temp;
-        }
-        else
-        {
-            curr = curr->next;
-        }
-    }
-}
-
-// Freed memory => insert inlogical WITHOUT coalescing
-void freeMemoryBlock(MemBlock *block, MemBlock *&logicalList)
-{
-    int startAddr = block->start;
-    int endAddr = block->start + block->size - 1;
-    int procID = block->processID;
-    block->processID = -1;
-    insertFreeBlock(block, logicalList);
-}
-
-// -----------------------------------------------------------------------------
-// Global fakeMemory array for printing physical addresses
 // -----------------------------------------------------------------------------
-static vector<int> physicalMemory; // This will be resized to maxMemory in main()
-
-// -----------------------------------------------------------------------------
-// Allocation and Loading
+// Command-line tool
+//
+//   OsProject [options] < input.txt
+//
+// Parses the options into SimOptions and runs one Simulator over the input,
+// printing to stdout. All of the simulation lives in OsSim.cpp.
 // -----------------------------------------------------------------------------
 
-// Helper function to print the new job queue.
-void printNewJobQueue(queue<int> newJobQueue, const vector<Process> &processes)
-{
-    cout << "----- New Job Queue Contents -----" << endl;
-    if (newJobQueue.empty())
-    {
-        cout << "New Job Queue is empty." << endl;
-    }
-    while (!newJobQueue.empty())
-    {
-        int idx = newJobQueue.front();
-        newJobQueue.pop();
-        // Print the process index and its process ID (or any other info you want)
-        cout << "Queue Entry - Index: " << idx
-             << ", Process ID: " << processes[idx].processID << endl;
-    }
-    cout << "----------------------------------" << endl;
-}
-
-MemBlock *allocateMemoryForJob(MemBlock *&logicalList, Process &job)
+void printUsage()
 {
-    int requiredSize = 10 + job.maxMemoryNeeded;
-    MemBlock *current = logicalList;
-    MemBlock *prev = nullptr;
-
-    while (current)
-    {
-        if (current->processID == -1 && current->size >= requiredSize)
-        {
-            if (current->size == requiredSize)
-            {
-                if (!prev)
-                {
-                    logicalList = current->next;
-                }
-                else
-                {
-                    prev->next = current->next;
-                }
-                current->next = nullptr;
-                current->processID = job.processID;
-                current->content.resize(requiredSize, 0);
-                return current;
-            }
-            else
-            {
-                MemBlock *allocated = new MemBlock();
-                allocated->processID = job.processID;
-                allocated->start = current->start;
-                allocated->size = requiredSize;
-                allocated->content.resize(requiredSize, 0);
-                current->start += requiredSize;
-                current->size -= requiredSize;
-                return allocated;
-            }
-        }
-        prev = current;
-        current = current->next;
-    }
-    return nullptr;
+    cout << "Usage: OsProject [options] < input.txt\n"
+         << "  --latency-report       print turnaround/response statistics\n"
+         << "  --zero-on-free         scrub segments in physical memory when they are freed\n"
+         << "  --placement=POLICY     segment placement: first, best, worst or next (default first)\n"
+         << "  --max-segments=N       maximum segments per process (default 6)\n"
+         << "  --io-device=SPEC       add an I/O device (repeatable), SPEC is\n"
+         << "                         name[,disc=fcfs|priority|sstf][,slots=N]\n"
+         << "                         [,latency=fixed|uniform|exp][,scale=X][,jitter=X]\n"
+         << "                         [,tracks=N][,seek=X]\n"
+         << "  --share-code           share one code segment among processes running the same program\n"
+         << "  --no-fusion            interpret one instruction at a time (reference engine)\n"
+         << "  --extended-opcodes     run opcodes 5-10 (jumps, loops, memset, memcpy)\n"
+         << "  --jump-limit=N         stop a process after N taken jumps and loops (default 1000000, 0 = none)\n"
+         << "  --banks=N              split physical memory into N banks (default 1)\n"
+         << "  --bank-latency=L,...   extra store/load cycles per bank; the last value repeats\n"
+         << "  --remote-penalty=N     extra cycles for an access outside the process's home bank\n"
+         << "  --bank-placement=MODE  local (keep a process in one bank if possible) or any\n"
+         << "  --cache=SPEC           add a cache level (repeatable, first is closest to the CPU), SPEC is\n"
+         << "                         name[,size=N][,assoc=N][,line=N][,latency=N][,policy=lru|plru]\n"
+         << "  --memory-latency=N     extra cycles for an access that misses every cache (default 10)\n"
+         << "  --flush-cache-on-switch  empty the caches whenever another process is dispatched\n"
+         << "  --swap                 swap out I/O-blocked processes when a new job does not fit\n"
+         << "  --swap-file=PATH       backing file for swapped images (default swap.bin)\n"
+         << "  --swap-after=N         cycles a process must wait on I/O before it may be swapped (default 10)\n"
+         << "  --swap-latency=N       fixed cycles per swap transfer (default 20)\n"
+         << "  --swap-rate=N          cells transferred per cycle (default 16)\n"
+         << "  --producers=N          start N in-process threads submitting generated jobs\n"
+         << "  --producer-jobs=N      jobs each producer submits (default 100)\n"
+         << "  --submit-batch=N       submitted jobs taken per loadWaitingJobs call (default 64)\n"
+         << "  --snapshot-every=N     write a binary physical memory snapshot every N cycles\n"
+         << "  --snapshot-file=PATH   snapshot file (default memory.snap)\n"
+         << "  --keyframe-every=N     full keyframe every N snapshots, deltas in between (default 16)\n"
+         << "  --bench-core=N         time the execution core per timing policy and opcode set and exit\n"
+         << "  --self-check           check the SIMD memory primitives against plain loops and exit\n"
+         << "  --loader-threads=N     build admitted process images on N worker threads\n"
+         << "  --control-socket=PATH  accept jobs and stats queries on a Unix domain socket\n"
+         << "  --profile-memory[=W]   report requested vs touched memory per process (working set window W, default 32)\n"
+         << "  --adaptive-quantum[=MIN,MAX]  size the time slice from observed CPU bursts (default bounds 1 and 4x the header quantum)\n"
+         << "  --no-compact-queue     store queued jobs' instructions as plain cells\n"
+         << "  --prestage[=K]         prepare the next K queued jobs for admission on a helper thread (default 4)\n"
+         << "  --sample=D,F[,W]       sampled simulation: per period, W warm-up (default 1), D measured and F\n"
+         << "                         fast-forwarded time slices; reports 95% access cost intervals\n"
+         << "  --sample-validate      run the trace in full and sampled and compare the results\n"
+         << "  --host-timers[=PATH]   write per-subsystem host latency histograms as JSON (default host_timers.json)\n"
+         << "  --result-cache=DIR     reuse the stored output of an identical earlier run from DIR\n"
+         << "  --verify-cache[=P]     rerun P percent of result cache hits and check the output (default 100)\n";
 }
 
-bool loadJobIntoBlock(const Process &proc, MemBlock *block)
+// Parse an --io-device value: a name followed by comma-separated key=value pairs.
+bool parseIODevice(const string &spec, IODeviceConfig &cfg)
 {
-    vector<int> instrList;
-    vector<int> operandList;
-
-    for (size_t i = 0; i < proc.instructions.size();)
-    {
-        int opcode = proc.instructions[i];
-        instrList.push_back(opcode);
-        int numOperands = 0;
-        switch (opcode)
-        {
-        case 1:
-            numOperands = 2;
-            break;
-        case 2:
-            numOperands = 1;
-            break;
-        case 3:
-            numOperands = 2;
-            break;
-        case 4:
-            numOperands = 1;
-            break;
-        default:
-            break;
-        }
-        for (int j = 0; j < numOperands; j++)
-        {
-            if ((i + 1) < proc.instructions.size())
-            {
-                operandList.push_back(proc.instructions[i + 1]);
-                i++;
-            }
-        }
-        i++;
-    }
-
-    int instructionCount = (int)instrList.size();
-    int operandCount = (int)operandList.size();
-    int totalMem = proc.maxMemoryNeeded;
-    int remainData = totalMem - (instructionCount + operandCount);
-
-    if (remainData < 0)
-    {
-        cout << "Error: Process " << proc.processID
-             << " requires more memory than allocated!" << endl;
+    vector<string> parts;
+    stringstream ss(spec);
+    string item;
+    while (getline(ss, item, ','))
+        parts.push_back(item);
+    if (parts.empty() || parts[0].empty())
         return false;
+    cfg.name = parts[0];
+    for (size_t i = 1; i < parts.size(); i++)
+    {
+        size_t eq = parts[i].find('=');
+        if (eq == string::npos)
+            return false;
+        string key = parts[i].substr(0, eq);
+        string value = parts[i].substr(eq + 1);
+        if (key == "disc" && value == "fcfs")
+            cfg.discipline = IO_FCFS;
+        else if (key == "disc" && value == "priority")
+            cfg.discipline = IO_PRIORITY;
+        else if (key == "disc" && value == "sstf")
+            cfg.discipline = IO_SSTF;
+        else if (key == "slots")
+            cfg.concurrency = atoi(value.c_str());
+        else if (key == "latency" && value == "fixed")
+            cfg.latency = IO_LATENCY_FIXED;
+        else if (key == "latency" && value == "uniform")
+            cfg.latency = IO_LATENCY_UNIFORM;
+        else if (key == "latency" && value == "exp")
+            cfg.latency = IO_LATENCY_EXP;
+        else if (key == "scale")
+            cfg.scale = atof(value.c_str());
+        else if (key == "jitter")
+            cfg.jitter = atof(value.c_str());
+        else if (key == "tracks" && atoi(value.c_str()) > 0)
+            cfg.tracks = atoi(value.c_str());
+        else if (key == "seek")
+            cfg.seekCost = atof(value.c_str());
+        else
+            return false;
     }
-
-    // Setup PCB in block->content (all stored as relative values)
-    block->content[0] = proc.processID;        // ID
-    block->content[1] = STATE_RUNNING;         // state
-    block->content[2] = 0;                     // relative PC
-    block->content[3] = 10;                    // relative instruction base
-    block->content[4] = 10 + instructionCount; // relative data base
-    block->content[5] = totalMem;              // memory limit
-    block->content[6] = 0;                     // CPU cycles used
-    block->content[7] = 0;                     // register
-    block->content[8] = totalMem;              // duplicate memory limit
-    block->content[9] = block->start;          // physical base
-
-    // Copy instructions and operands into block->content
-    int instrIndex = 10;
-    for (int instr : instrList)
-    {
-        if (instrIndex < (int)block->content.size())
-            block->content[instrIndex++] = instr;
-    }
-    int dataIndex = 10 + instructionCount;
-    for (int op : operandList)
-    {
-        if (dataIndex < (int)block->content.size())
-            block->content[dataIndex++] = op;
-    }
-    for (int i = 0; i < remainData; i++)
-    {
-        if (dataIndex + i < (int)block->content.size())
-            block->content[dataIndex + i] = -1;
-    }
-
     return true;
 }
 
-// -----------------------------------------------------------------------------
-// loadWaitingJobs: Coalesce only if a job fails to fit on first try
-// -----------------------------------------------------------------------------
-void printAllocatedSegments(const vector<MemBlock *> &segments, int processID)
+// Parse a --cache value: a name followed by comma-separated key=value pairs.
+bool parseCache(const string &spec, CacheConfig &cfg)
 {
-    logBuffer << "Process " << processID << " allocated segments:" << endl;
-    int totalSize = 0; // Accumulate total size
-    for (size_t i = 0; i < segments.size(); i++)
-    {
-        int start = segments[i]->start;
-        int size = segments[i]->size;
-        int end = start + size - 1;
-        totalSize += size;
-        logBuffer << "  Segment " << i << ": Start = " << start
-                  << ", End = " << end
-                  << ", Size = " << size << endl;
-    }
-    // Append the total size at the end.
-    logBuffer << "Total size allocated: " << totalSize << endl;
-}
-
-// A function to output all accumulated logs at the end.
-void flushLogs()
-{
-    cout << logBuffer.str();
-    // cout << freeListLog.str();
-}
-
-// A helper function to capture the current free list.
-void captureFreeList(MemBlock *freeList, string type)
-{
-
-    freeListLog << type;
-    for (MemBlock *current = freeList; current != nullptr; current = current->next)
-    {
-
-        freeListLog << "[Start:" << current->start << ", Size:" << current->size
-                    << ", End:" << current->start + current->size - 1 << "] -> " << "\n";
-    }
-
-    freeListLog << "\n";
-}
-
-// Define error codes for clarity:
-#define ALLOC_ERROR_NONE 0
-#define ALLOC_ERROR_NO_SEGMENT_BLOCK 1
-#define ALLOC_ERROR_INSUFFICIENT_FREE_MEMORY 2
-
-vector<MemBlock *> allocateProcessSegments(MemBlock *&segmentedMemory, Process &job, int &errorCode)
-{
-    vector<MemBlock *> segments;
-    errorCode = ALLOC_ERROR_NONE; // assume success to start
-
-    // Calculate the total number of cells needed:
-    // 10 for PCB fields, 13 for a minimum segment table reservation,
-    // plus job.maxMemoryNeeded cells for the process data.
-    int requiredTotal = 10 + 13 + job.maxMemoryNeeded;
-    int allocatedTotal = 0;
-
-    captureFreeList(segmentedMemory, "before");
-    coalesceFreeList(segmentedMemory);
-
-    // ***** Preliminary Check: Separate Conditions *****
-    int totalFree = 0;
-    bool foundBlockOf13 = false;
-    for (MemBlock *iter = segmentedMemory; iter != nullptr; iter = iter->next)
-    {
-        if (iter->processID == -1)
-        {
-            totalFree += iter->size;
-            if (iter->size >= 13)
-                foundBlockOf13 = true;
-        }
-    }
-    // First check: Is there at least one free block of size >= 13?
-    if (!foundBlockOf13)
-    {
-        errorCode = ALLOC_ERROR_NO_SEGMENT_BLOCK;
-        return segments;
-    }
-    // Second check: Is the total free memory available enough for the required total?
-    if (totalFree < requiredTotal)
-    {
-        errorCode = ALLOC_ERROR_INSUFFICIENT_FREE_MEMORY;
-        return segments;
-    }
-    // ***** End Preliminary Checks *****
-
-    // STEP 1: Find the first free block that is large enough (>= 13 cells) for the segment table.
-    MemBlock *prev = nullptr, *current = segmentedMemory;
-    while (current != nullptr)
-    {
-        if (current->processID == -1 && current->size >= 13)
-            break;
-        prev = current;
-        current = current->next;
-    }
-    if (current == nullptr)
-    {
-        // This should not occur because the preliminary check passed.
-        errorCode = ALLOC_ERROR_NO_SEGMENT_BLOCK;
-        return segments;
-    }
-
-    // Record the boundary address. Only blocks with start >= this will be used
-    // for additional allocations.
-    int boundary = current->start;
-
-    // STEP 2: Allocate from the found block.
-    int needed = requiredTotal - allocatedTotal;
-    // Ensure the first allocated segment gets at least 13 cells.
-    if (segments.empty() && needed < 13)
-        needed = 13;
-
-    if (current->size > needed)
-    {
-        // Allocate 'needed' cells from this block by splitting.
-        MemBlock *allocatedBlock = new MemBlock();
-        allocatedBlock->processID = job.processID;
-        allocatedBlock->start = current->start;
-        allocatedBlock->size = needed;
-        allocatedBlock->content.resize(needed, -1);
-        allocatedBlock->next = nullptr;
-        segments.push_back(allocatedBlock);
-        allocatedTotal += needed;
-
-        // Adjust the free block.
-        current->start += needed;
-        current->size -= needed;
-    }
-    else
-    {
-        // current->size exactly equals needed: remove block from free list.
-        if (prev == nullptr)
-            segmentedMemory = current->next;
-        else
-            prev->next = current->next;
-        current->next = nullptr;
-        current->processID = job.processID;
-        segments.push_back(current);
-        allocatedTotal += current->size;
-    }
-
-    // STEP 3: Gather additional free blocks (only considering blocks that come after our boundary)
-    // until allocatedTotal >= requiredTotal, but do not allow more than 6 segments per process.
-    // Here we iterate over the free list and skip any block whose 'start' is less than boundary.
-    MemBlock *prev2 = nullptr;
-    MemBlock *p = segmentedMemory;
-    while (allocatedTotal < requiredTotal && p != nullptr && segments.size() < 6)
-    {
-        if (p->start < boundary)
-        {
-            // Skip blocks that come before the boundary.
-            prev2 = p;
-            p = p->next;
-            continue;
-        }
-
-        // Remove p from the free list.
-        MemBlock *block = p;
-        p = p->next;
-        if (prev2 == nullptr)
-        {
-            segmentedMemory = p;
-        }
-        else
-        {
-            prev2->next = p;
-        }
-        block->next = nullptr;
-
-        // Only consider free blocks.
-        if (block->processID != -1)
-        {
-            continue;
-        }
-
-        int stillNeeded = requiredTotal - allocatedTotal;
-
-        // CASE 1: block size exactly matches the remaining needed.
-        if (block->size == stillNeeded)
-        {
-            block->processID = job.processID;
-            segments.push_back(block);
-            allocatedTotal += block->size;
-        }
-        // CASE 2: block size is larger than needed => split it.
-        else if (block->size > stillNeeded)
-        {
-            MemBlock *allocatedBlock = new MemBlock();
-            allocatedBlock->processID = job.processID;
-            allocatedBlock->start = block->start;
-            allocatedBlock->size = stillNeeded;
-            allocatedBlock->content.resize(stillNeeded, -1);
-            allocatedBlock->next = nullptr;
-            segments.push_back(allocatedBlock);
-            allocatedTotal += stillNeeded;
-
-            // Adjust the free block to reflect the split.
-            block->start += stillNeeded;
-            block->size -= stillNeeded;
-            // Mark it free again.
-            block->processID = -1;
-            // Reinsert the leftover block into segmentedMemory (keeping it sorted by start).
-            insertFreeBlock(block, segmentedMemory);
-        }
-        // CASE 3: block is smaller than needed => take the whole block and continue.
+    vector<string> parts;
+    stringstream ss(spec);
+    string item;
+    while (getline(ss, item, ','))
+        parts.push_back(item);
+    if (parts.empty() || parts[0].empty())
+        return false;
+    cfg.name = parts[0];
+    for (size_t i = 1; i < parts.size(); i++)
+    {
+        size_t eq = parts[i].find('=');
+        if (eq == string::npos)
+            return false;
+        string key = parts[i].substr(0, eq);
+        string value = parts[i].substr(eq + 1);
+        int number = atoi(value.c_str());
+        if (key == "size" && number > 0)
+            cfg.size = number;
+        else if (key == "assoc" && number > 0)
+            cfg.assoc = number;
+        else if (key == "line" && number > 0)
+            cfg.line = number;
+        else if (key == "latency" && number >= 0)
+            cfg.latency = number;
+        else if (key == "policy" && value == "lru")
+            cfg.policy = CACHE_LRU;
+        else if (key == "policy" && value == "plru")
+            cfg.policy = CACHE_PLRU;
         else
-        {
-            block->processID = job.processID;
-            segments.push_back(block);
-            allocatedTotal += block->size;
-        }
-    }
-
-    // STEP 4: If we have reached the maximum segment count and still haven't allocated enough memory,
-    // the allocation fails.
-    if (allocatedTotal < requiredTotal)
-    {
-        // Roll back: Mark all allocated blocks as free and reinsert them.
-        for (MemBlock *blk : segments)
-        {
-            blk->processID = -1; // Mark block free.
-            insertFreeBlock(blk, segmentedMemory);
-        }
-        segments.clear(); // Indicate failure.
-        errorCode = ALLOC_ERROR_INSUFFICIENT_FREE_MEMORY;
-    }
-
-    return segments;
-}
-
-bool loadJobIntoSegments(const Process &proc, vector<MemBlock *> &segments)
-{
-    // Step 0: Ensure each segment's content array is resized properly.
-    for (size_t i = 0; i < segments.size(); i++)
-    {
-        segments[i]->content.resize(segments[i]->size, -1);
-    }
-
-    // Step 1: Separate the instructions and operands from the process.
-    vector<int> instrList;
-    vector<int> operandList;
-    for (size_t i = 0; i < proc.instructions.size();)
-    {
-        int opcode = proc.instructions[i];
-        instrList.push_back(opcode);
-        int numOperands = 0;
-        switch (opcode)
-        {
-        case 1:
-            numOperands = 2;
-            break; // compute
-        case 2:
-            numOperands = 1;
-            break; // print
-        case 3:
-            numOperands = 2;
-            break; // store
-        case 4:
-            numOperands = 1;
-            break; // load
-        default:
-            break;
-        }
-        for (int j = 0; j < numOperands; j++)
-        {
-            if ((i + 1) < proc.instructions.size())
-            {
-                operandList.push_back(proc.instructions[i + 1]);
-                i++; // advance for each operand
-            }
-        }
-        i++; // advance to next instruction/opcode
-    }
-
-    int instructionCount = (int)instrList.size();
-    int operandCount = (int)operandList.size();
-
-    // Step 2: Build a contiguous logical image similar to loadJobIntoBlock.
-    // In the old code, the first 10 cells were for the PCB, so let’s assume:
-    //   - We reserve a segment table at the beginning.
-    // Let the segment table size be 2*number_of_segments (each segment: start and size)
-    int numSegments = segments.size();
-    int segTableSize = numSegments * 2; // two entries per segment
-    int PCBFields = 10;                 // fixed 10 PCB fields
-    int totalLogicalSize = segTableSize + 1 + PCBFields + instructionCount + operandCount;
-
-    // Create a temporary contiguous array for the process image.
-    vector<int> logicalMemory(totalLogicalSize, -1);
-
-    // Write the segment table at the beginning:
-    // At index 0, we store segTableSize. Then store each segment's physical start and size.
-    logicalMemory[0] = segTableSize;
-    for (int i = 0; i < numSegments; i++)
-    {
-        logicalMemory[1 + 2 * i] = segments[i]->start;
-        logicalMemory[2 + 2 * i] = segments[i]->size;
-    }
-
-    // Write the PCB fields.
-    // PCB fields start at index = segTableSize + 1.
-    int offset = segTableSize + 1;
-    logicalMemory[offset + 0] = proc.processID; // Process ID
-    logicalMemory[offset + 1] = STATE_RUNNING;  // State
-    logicalMemory[offset + 2] = 0;              // Relative PC
-    // The following two fields are normally set to 10 in the old code, so we adjust them.
-    logicalMemory[offset + 3] = 10 + offset;                    // Instruction Base (adjust by offset)
-    logicalMemory[offset + 4] = 10 + offset + instructionCount; // Data Base (after instructions)
-    logicalMemory[offset + 5] = proc.maxMemoryNeeded;           // Memory limit
-    logicalMemory[offset + 6] = 0;                              // CPU Cycles Used
-    logicalMemory[offset + 7] = 0;                              // Register Value
-    logicalMemory[offset + 8] = proc.maxMemoryNeeded;           // Duplicate Memory Limit
-    // Main Memory Base: we use the start of the first segment.
-    logicalMemory[offset + 9] = segments[0]->start;
-
-    // Write the instructions and operands immediately following the PCB fields.
-    int dataStart = offset + PCBFields;
-    int index = dataStart;
-    for (int instr : instrList)
-    {
-        if (index < totalLogicalSize)
-            logicalMemory[index++] = instr;
-    }
-    for (int op : operandList)
-    {
-        if (index < totalLogicalSize)
-            logicalMemory[index++] = op;
-    }
-
-    // Step 3: Distribute the contiguous logicalMemory into the allocated segments.
-    // This is similar to our old distribution loop but iterating over segments.
-    int logicalIndex = 0;
-    for (size_t seg = 0; seg < segments.size() && logicalIndex < totalLogicalSize; seg++)
-    {
-        for (int j = 0; j < segments[seg]->size && logicalIndex < totalLogicalSize; j++)
-        {
-            segments[seg]->content[j] = logicalMemory[logicalIndex++];
-        }
-    }
-
-    // Step 4: Update PhysicalMemory for every segment.
-    for (size_t seg = 0; seg < segments.size(); seg++)
-    {
-        for (int j = 0; j < segments[seg]->size; j++)
-        {
-            physicalMemory[segments[seg]->start + j] = segments[seg]->content[j];
-        }
-    }
-
-    return (logicalIndex == totalLogicalSize);
-}
-
-// Helper function to print details about allocated segmented blocks.
-
-// Debugging function to print allocated blocks for a process.
-void printAllocatedBlocksForProcess(int processID, const vector<MemBlock *> &segments)
-{
-    cout << "Process " << processID << " allocated blocks:" << endl;
-    for (size_t i = 0; i < segments.size(); i++)
-    {
-        MemBlock *block = segments[i];
-        cout << "  Block " << i
-             << " -> Start: " << block->start
-             << ", Size: " << block->size << endl;
+            return false;
     }
+    // Tree PLRU splits the ways in halves.
+    if (cfg.policy == CACHE_PLRU && (cfg.assoc & (cfg.assoc - 1)) != 0)
+        return false;
+    return true;
 }
 
-void loadWaitingJobs(queue<int> &newJobQueue,
-                     vector<Process> &processes,
-                     MemBlock *&logicalList,        // contiguous (logical) free list for execution
-                     MemBlock *&segmentedMemory,    // free list for segmented allocation
-                     queue<MemBlock *> &readyQueue) // readyQueue for execution (contains contiguous block)
+// Options are --name or --name=value. Returns false on an unknown option.
+bool parseCommandLine(int argc, char **argv, SimOptions &simOptions)
 {
-    // Process jobs one at a time from the newJobQueue.
-    while (!newJobQueue.empty())
-    {
-        int idx = newJobQueue.front(); // Look at the first process (do not pop yet)
-        Process &job = processes[idx];
-
-        // cout << "Process " << job.processID
-        //      << " - Free segments BEFORE allocation:" << endl;
-        // printFreeList(segmentedMemory, "Free segments before load", "watever");
-
-        // Attempt to allocate segmented memory for this process.
-
-        int allocError = ALLOC_ERROR_NONE;
-        vector<MemBlock *> segments = allocateProcessSegments(segmentedMemory, job, allocError);
-
-        // If segmented memory allocation fails...
-        if (segments.empty())
-        {
-
-            if (allocError == ALLOC_ERROR_NO_SEGMENT_BLOCK)
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string name = arg.substr(0, eq);
+        string value = eq == string::npos ? "" : arg.substr(eq + 1);
+
+        if (name == "--latency-report")
+            simOptions.latencyReport = true;
+        else if (name == "--zero-on-free")
+            simOptions.zeroOnFree = true;
+        else if (name == "--placement" && value == "first")
+            simOptions.placement = PLACE_FIRST_FIT;
+        else if (name == "--placement" && value == "best")
+            simOptions.placement = PLACE_BEST_FIT;
+        else if (name == "--placement" && value == "worst")
+            simOptions.placement = PLACE_WORST_FIT;
+        else if (name == "--placement" && value == "next")
+            simOptions.placement = PLACE_NEXT_FIT;
+        else if (name == "--max-segments" && atoi(value.c_str()) >= 1)
+            simOptions.maxSegments = atoi(value.c_str());
+        else if (name == "--share-code")
+            simOptions.shareCode = true;
+        else if (name == "--no-fusion")
+            simOptions.fuseInstructions = false;
+        else if (name == "--extended-opcodes")
+            simOptions.extendedOpcodes = true;
+        else if (name == "--jump-limit" && atoll(value.c_str()) >= 0 && !value.empty())
+            simOptions.jumpLimit = atoll(value.c_str());
+        else if (name == "--banks" && atoi(value.c_str()) >= 1)
+            simOptions.banks = atoi(value.c_str());
+        else if (name == "--bank-latency" && !value.empty())
+        {
+            simOptions.bankLatency.clear();
+            stringstream list(value);
+            string item;
+            while (getline(list, item, ','))
+                simOptions.bankLatency.push_back(max(0, atoi(item.c_str())));
+        }
+        else if (name == "--remote-penalty" && atoi(value.c_str()) >= 0)
+            simOptions.remotePenalty = atoi(value.c_str());
+        else if (name == "--bank-placement" && (value == "local" || value == "any"))
+            simOptions.bankLocal = value == "local";
+        else if (name == "--cache")
+        {
+            CacheConfig cfg;
+            if (!parseCache(value, cfg))
             {
-                cout << "Process " << job.processID
-                     << " could not be loaded due to insufficient contiguous space for segment table." << endl;
-                break; // or continue to the next job based on your scheduling policy.
+                cout << "Error: bad cache " << value << endl;
+                return false;
             }
-            else if (allocError == ALLOC_ERROR_INSUFFICIENT_FREE_MEMORY)
+            simOptions.caches.push_back(cfg);
+        }
+        else if (name == "--memory-latency" && atoi(value.c_str()) >= 0)
+            simOptions.memoryLatency = atoi(value.c_str());
+        else if (name == "--flush-cache-on-switch")
+            simOptions.flushCacheOnSwitch = true;
+        else if (name == "--swap")
+            simOptions.swapping = true;
+        else if (name == "--swap-file" && !value.empty())
+            simOptions.swapFile = value;
+        else if (name == "--swap-after" && atoi(value.c_str()) >= 0)
+            simOptions.swapAfter = atoi(value.c_str());
+        else if (name == "--swap-latency" && atoi(value.c_str()) >= 0)
+            simOptions.swapLatency = atoi(value.c_str());
+        else if (name == "--swap-rate" && atoi(value.c_str()) >= 1)
+            simOptions.swapRate = atoi(value.c_str());
+        else if (name == "--producers" && atoi(value.c_str()) >= 0)
+            simOptions.producers = atoi(value.c_str());
+        else if (name == "--producer-jobs" && atoi(value.c_str()) >= 0)
+            simOptions.jobsPerProducer = atoi(value.c_str());
+        else if (name == "--submit-batch" && atoi(value.c_str()) >= 1)
+            simOptions.submitBatch = atoi(value.c_str());
+        else if (name == "--snapshot-every" && atoi(value.c_str()) >= 1)
+            simOptions.snapshotEvery = atoi(value.c_str());
+        else if (name == "--snapshot-file" && !value.empty())
+            simOptions.snapshotFile = value;
+        else if (name == "--keyframe-every" && atoi(value.c_str()) >= 1)
+            simOptions.keyframeEvery = atoi(value.c_str());
+        else if (name == "--bench-core" && atoi(value.c_str()) >= 1)
+            simOptions.benchCore = atoi(value.c_str());
+        else if (name == "--self-check")
+            simOptions.selfCheck = true;
+        else if (name == "--loader-threads" && atoi(value.c_str()) >= 0)
+            simOptions.loaderThreads = atoi(value.c_str());
+        else if (name == "--control-socket" && !value.empty())
+            simOptions.controlSocket = value;
+        else if (name == "--no-compact-queue")
+            simOptions.compactQueue = false;
+        else if (name == "--prestage" && (value.empty() || atoi(value.c_str()) >= 1))
+            simOptions.prestageDepth = value.empty() ? 4 : atoi(value.c_str());
+        else if (name == "--sample")
+        {
+            int detailed = 0, forward = 0, warmup = 1;
+            int fields = sscanf(value.c_str(), "%d,%d,%d", &detailed, &forward, &warmup);
+            if (fields < 2 || detailed < 1 || forward < 0 || warmup < 0)
             {
-                // Print the free list before coalescing.
-                cout << "Insufficient memory for Process " << job.processID
-                     << ". Attempting memory coalescing." << endl;
-
-                coalesceFreeList(segmentedMemory);
-
-                // Try allocation again.
-                segments = allocateProcessSegments(segmentedMemory, job, allocError);
+                cout << "Error: bad sampling period " << value << endl;
+                return false;
             }
-
-            if (segments.empty())
+            simOptions.sampleDetailed = detailed;
+            simOptions.sampleForward = forward;
+            simOptions.sampleWarmup = warmup;
+        }
+        else if (name == "--sample-validate")
+            simOptions.sampleValidate = true;
+        else if (name == "--result-cache" && !value.empty())
+            simOptions.resultCache = value;
+        else if (name == "--verify-cache" && (value.empty() || (atoi(value.c_str()) >= 0 && atoi(value.c_str()) <= 100)))
+            simOptions.verifyCachePercent = value.empty() ? 100 : atoi(value.c_str());
+        else if (name == "--host-timers")
+        {
+            simOptions.hostTimers = true;
+            if (!value.empty())
+                simOptions.hostTimersFile = value;
+        }
+        else if (name == "--adaptive-quantum")
+        {
+            simOptions.adaptiveQuantum = true;
+            if (!value.empty())
             {
-                cout << "Process " << job.processID
-                     << " waiting in NewJobQueue due to insufficient memory." << endl;
-                // Since the process at the head cannot be loaded even after coalescing,
-                // break out of the loop to stop checking further processes.
-                break;
+                size_t comma = value.find(',');
+                simOptions.quantumMin = atoi(value.substr(0, comma).c_str());
+                simOptions.quantumMax = comma == string::npos ? 0 : atoi(value.substr(comma + 1).c_str());
+                // Without MAX, quantumMax stays 0 and the controller picks the default.
+                if (simOptions.quantumMin < 1 ||
+                    (comma != string::npos && simOptions.quantumMax < simOptions.quantumMin))
+                {
+                    cout << "Error: bad quantum bounds " << value << endl;
+                    return false;
+                }
             }
         }
-
-        // If segmented allocation succeeded, load the process image into these segments.
-        if (loadJobIntoSegments(job, segments))
-        {
-
-            cout << "Process " << job.processID
-                 << " loaded with segment table stored at physical address "
-                 << segments[0]->start << endl;
-
-            // Save the allocated segmented blocks into the Process object for later freeing.
-
-            job.segmentedBlocks = segments;
-
-            printAllocatedSegments(segments, job.processID);
-        }
-        else
-        {
-            cout << "Process " << job.processID
-                 << " failed to load into segmented memory." << endl;
-            // Remove this process from the newJobQueue and continue.
-            newJobQueue.pop();
-            continue;
-        }
-
-        // Allocate a contiguous block from the logical free list for execution.
-        MemBlock *contiguousBlock = allocateMemoryForJob(logicalList, job);
-        if (contiguousBlock == nullptr || !loadJobIntoBlock(job, contiguousBlock))
-        {
-            cout << "Contiguous allocation or load failed for Process " << job.processID << endl;
-            // Stop processing further if contiguous allocation fails.
-            break;
-        }
-
-        // If both segmented and contiguous allocations succeeded, push the process to readyQueue.
-        readyQueue.push(contiguousBlock);
-
-        // Finally, remove the process from the newJobQueue (it is now loaded).
-        newJobQueue.pop();
-    }
-}
-
-// -----------------------------------------------------------------------------
-// Execution
-// -----------------------------------------------------------------------------
-int computeOperandPointerFromBlock(const vector<int> &mem,
-                                   int instructionBase,
-                                   int dataBase,
-                                   int programCounter)
-{
-    int operandCount = 0;
-    for (int i = 0; i < programCounter; i++)
-    {
-        int opcode = mem[instructionBase + i];
-        switch (opcode)
-        {
-        case 1:
-            operandCount += 2;
-            break;
-        case 2:
-            operandCount += 1;
-            break;
-        case 3:
-            operandCount += 2;
-            break;
-        case 4:
-            operandCount += 1;
-            break;
-        default:
-            break;
-        }
-    }
-    return dataBase + operandCount;
-}
-
-// Translates a logical address to a physical address using the segment table
-// stored in the first allocated block from the process's segmented blocks vector.
-//
-// Parameters:
-//   logicalAddress - the address generated by the CPU (logical address)
-//   segBlocks      - the vector of allocated segments for the process; the
-//                    first element contains the segment table.
-// Returns the corresponding physical address or -1 if the address is invalid.
-int translateLogicalToPhysical(int logicalAddress, const vector<MemBlock *> &segBlocks)
-{
-    if (segBlocks.empty() || segBlocks[0]->content.empty())
-    {
-        cout << "Error: No segment table found." << endl;
-        return -1;
-    }
-
-    // The segment table is stored in the first block.
-    int segTableSize = segBlocks[0]->content[0];
-    int numSegments = segTableSize / 2;
-    int remaining = logicalAddress;
-
-    for (int i = 0; i < numSegments; i++)
-    {
-        // The table is stored in segBlocks[0]->content:
-        //   [1+2*i] is the physical start for segment i.
-        //   [2+2*i] is the size (length) of segment i.
-        int segmentStart = segBlocks[0]->content[1 + 2 * i];
-        int segmentSize = segBlocks[0]->content[1 + 2 * i + 1];
-
-        if (remaining < segmentSize)
-        {
-            // The logical address falls in this segment.
-            int physicalAddress = segmentStart + remaining;
-            return physicalAddress;
-        }
-        else
-        {
-            remaining -= segmentSize;
-        }
-    }
-
-    cout << "Memory violation: logical address " << logicalAddress << " out of bounds." << endl;
-    return -1; // return error code if address is invalid
-}
-
-bool executeProcess(MemBlock *block,
-                    int &totalCpuCycles,
-                    int globalCPUAllocated,
-                    int startTime, const vector<MemBlock *> &segBlocks)
-{
-    vector<int> &mem = block->content;
-    int processID = mem[0];
-    int &state = mem[1];
-    int &relProgramCounter = mem[2];
-    int relInstructionBase = mem[3];
-    int relDataBase = mem[4];
-    int memoryLimit = mem[5];
-    int &cpuCyclesUsed = mem[6];
-    int &registerValue = mem[7];
-    int maxMemoryNeeded = mem[8];
-    int mainMemoryBase = segBlocks.empty() ? mem[9] : segBlocks[0]->start;
-
-    cout << "Process " << processID << " has moved to Running." << endl;
-    state = STATE_RUNNING;
-
-    int timeSliceCounter = 0;
-    bool brokeEarly = false;
-
-    int operandPointer = computeOperandPointerFromBlock(
-        mem, relInstructionBase, relDataBase, relProgramCounter);
-
-    while ((relInstructionBase + relProgramCounter) < relDataBase)
-    {
-        int opcode = mem[relInstructionBase + relProgramCounter];
-        int numOperands = 0;
-        switch (opcode)
-        {
-        case 1:
-            numOperands = 2;
-            break;
-        case 2:
-            numOperands = 1;
-            break;
-        case 3:
-            numOperands = 2;
-            break;
-        case 4:
-            numOperands = 1;
-            break;
-        default:
-            break;
-        }
-        vector<int> operands(numOperands);
-        for (int i = 0; i < numOperands; i++)
+        else if (name == "--profile-memory" && (value.empty() || atoi(value.c_str()) >= 1))
         {
-            operands[i] = mem[operandPointer++];
+            simOptions.profileMemory = true;
+            if (!value.empty())
+                simOptions.profileWindow = atoi(value.c_str());
         }
-        if (opcode == 1)
+        else if (name == "--io-device")
         {
-            int cpuCycles = operands[1];
-            cpuCyclesUsed += cpuCycles;
-            timeSliceCounter += cpuCycles;
-            updateClock(totalCpuCycles, cpuCycles, "compute");
-            cout << "compute" << endl;
-        }
-        else if (opcode == 2)
-        {
-            int cpuCycles = operands[0];
-            cpuCyclesUsed += cpuCycles;
-            timeSliceCounter += cpuCycles;
-            relProgramCounter++;
-            state = STATE_IO_WAITING;
-            ioWaitTime = cpuCycles;
-            cout << "Process " << processID
-                 << " issued an IOInterrupt and moved to the IOWaitingQueue." << endl;
-            brokeEarly = true;
-            break;
-        }
-        else if (opcode == 3)
-        {
-            int value = operands[0];
-            int logicalAddr = operands[1];
-            int physicalAddr = relInstructionBase + logicalAddr;
-            int translatedAddress;
-            registerValue = value;
-            if (logicalAddr < memoryLimit)
-            {
-                mem[physicalAddr] = value;
-                translatedAddress = translateLogicalToPhysical(logicalAddr, segBlocks);
-
-                translatedAddress = translatedAddress;
-                cout << "stored" << endl;
-                cout << "Logical address " << logicalAddr << " translated to physical address "
-                     << translatedAddress << " for Process " << processID << endl;
-            }
-            else
-            {
-                cout << "store error!" << endl;
-            }
-            cpuCyclesUsed++;
-            timeSliceCounter++;
-            updateClock(totalCpuCycles, 1, "store");
-        }
-        else if (opcode == 4)
-        {
-            int logicalAddr = operands[0];
-            int physicalAddr = relInstructionBase + logicalAddr;
-            int translatedAddress;
-            if (logicalAddr < memoryLimit)
-            {
-                registerValue = mem[physicalAddr];
-                translatedAddress = translateLogicalToPhysical(logicalAddr, segBlocks);
-
-                translatedAddress = translatedAddress;
-                cout << "loaded" << endl;
-                cout << "Logical address " << logicalAddr << " translated to physical address "
-                     << translatedAddress << " for Process " << processID << endl;
-            }
-            else
+            IODeviceConfig cfg;
+            if (!parseIODevice(value, cfg))
             {
-                cout << "load error!" << endl;
+                cout << "Error: bad I/O device " << value << endl;
+                return false;
             }
-            cpuCyclesUsed++;
-            timeSliceCounter++;
-            updateClock(totalCpuCycles, 1, "load");
+            simOptions.ioDevices.push_back(cfg);
         }
-        if (!brokeEarly)
-        {
-            relProgramCounter++;
-        }
-        bool endOfInstructions = ((relInstructionBase + relProgramCounter) >= relDataBase);
-        if (!brokeEarly && timeSliceCounter >= globalCPUAllocated && !endOfInstructions)
+        else
         {
-            cout << "Process " << processID
-                 << " has a TimeOUT interrupt and is moved to the ReadyQueue." << endl;
-            brokeEarly = true;
-            break;
+            cout << "Error: unknown option " << arg << endl;
+            printUsage();
+            return false;
         }
     }
-    bool finishedAll = ((relInstructionBase + relProgramCounter) >= relDataBase);
-    if (!brokeEarly && finishedAll)
-    {
-        state = STATE_TERMINATED;
-        int physicalPC = mainMemoryBase + relProgramCounter;
-        int physicalInstructionBase = mainMemoryBase + relInstructionBase;
-        int physicalDataBase = mainMemoryBase + relDataBase;
-        int segTableSize = segBlocks.empty() ? mem[0] : segBlocks[0]->content[0];
-        int bias;
-
-        cout << "Process ID: " << processID << "\n"
-             << "State: TERMINATED\n"
-             << "Program Counter: " << (segTableSize + 10) << "\n"
-             << "Instruction Base: " << segTableSize + 11 << "\n"
-             << "Data Base: " << relDataBase + segTableSize + 1 << "\n"
-             << "Memory Limit: " << memoryLimit << "\n"
-             << "CPU Cycles Used: " << cpuCyclesUsed << "\n"
-             << "Register Value: " << registerValue << "\n"
-             << "Max Memory Needed: " << maxMemoryNeeded << "\n"
-             << "Main Memory Base: " << mainMemoryBase << "\n"
-             << "Total CPU Cycles Consumed: " << (totalCpuCycles - startTime) << "\n";
-
-        cout << "Process " << processID
-             << " terminated. Entered running state at: " << startTime
-             << ". Terminated at: " << totalCpuCycles
-             << ". Total Execution Time: "
-             << (totalCpuCycles - startTime)
-             << "." << endl;
-
-        return true;
-    }
-    return false;
-}
-
-// -----------------------------------------------------------------------------
-// I/O Handling
-// -----------------------------------------------------------------------------
-void checkIOQueueSimultaneously(queue<pair<MemBlock *, int>> &ioQueue,
-                                queue<MemBlock *> &readyQueue,
-                                int &totalCpuCycles)
-{
-    int originalSize = (int)ioQueue.size();
-    for (int i = 0; i < originalSize; i++)
+    if (simOptions.sampleValidate && simOptions.sampleDetailed == 0)
     {
-        auto ioEntry = ioQueue.front();
-        ioQueue.pop();
-        MemBlock *block = ioEntry.first;
-        int readyTime = ioEntry.second;
-        if (totalCpuCycles >= readyTime)
-        {
-            block->content[1] = STATE_NEW; // done waiting
-            int processID = block->content[0];
-            cout << "print" << endl;
-            cout << "Process " << processID
-                 << " completed I/O and is moved to the ReadyQueue." << endl;
-            readyQueue.push(block);
-        }
-        else
-        {
-            ioQueue.push({block, readyTime});
-        }
+        cout << "Error: --sample-validate needs --sample" << endl;
+        return false;
     }
+    return true;
 }
 
 // -----------------------------------------------------------------------------
-// Scheduler
+// Sampling validation
 // -----------------------------------------------------------------------------
+// Runs the trace once in full and once sampled, both without output, and
+// checks each sampled figure against the full one. Meant for traces small
+// enough to simulate in full, to choose a sampling period for larger ones.
 
-void updatePhysicalMemoryForSegments(const vector<MemBlock *> &segments)
+void printValidationLine(const char *label, const Estimate &full, const Estimate &sampled)
 {
-    for (size_t s = 0; s < segments.size(); s++)
-    {
-        for (int i = 0; i < segments[s]->size; i++)
-        {
-            physicalMemory[segments[s]->start + i] = segments[s]->content[i];
-        }
-    }
+    double error = full.value != 0 ? 100.0 * (sampled.value - full.value) / full.value : 0;
+    bool covered = fabs(sampled.value - full.value) <= sampled.halfWidth;
+    cout << label << ": full " << full.value << ", sampled " << sampled.value << " +/- " << sampled.halfWidth
+         << " (error " << error << "%, " << (covered ? "inside" : "outside") << " the interval)" << endl;
 }
 
-void schedulerLoop(queue<MemBlock *> &readyQueue,
-                   queue<pair<MemBlock *, int>> &ioQueue,
-                   queue<int> &newJobQueue,
-                   vector<Process> &processes,
-                   int globalCPUAllocated,
-                   int contextSwitchTime,
-                   MemBlock *&logicalList,     // contiguous pool for execution
-                   MemBlock *&segmentedMemory) // segmented allocation pool
+int validateSampling(const SimOptions &simOptions)
 {
-    int totalCpuCycles = 0;
-    const int MAX_IDLE_ITERATIONS = 1000; // maximum iterations to wait while idle
-    int idleIterationCount = 0;
-    MemBlock *runningBlock = nullptr;
-    bool firstProcessPicked = false;
-
-    // Load waiting processes.
-    loadWaitingJobs(newJobQueue, processes, logicalList, segmentedMemory, readyQueue);
-
-    for (int i = 0; i < (int)physicalMemory.size(); i++)
-    {
-        cout << i << " : " << physicalMemory[i] << "\n";
-    }
-
-    // Main scheduling loop.
-    while (!readyQueue.empty() || !ioQueue.empty() || !newJobQueue.empty())
-    {
-        // Check if we're idle: no ready or I/O work, but jobs are waiting in NewJobQueue.
-        if (readyQueue.empty() && ioQueue.empty() && !newJobQueue.empty())
-        {
-            // Increment idle iteration count.
-            idleIterationCount++;
-            // Optionally, simulate time passing by incrementing totalCpuCycles even if idle.
-            totalCpuCycles++;
-            // If we exceed threshold, exit gracefully.
-            if (idleIterationCount >= MAX_IDLE_ITERATIONS)
-            {
-                cout << "Error: A job has been stuck in the NewJobQueue for too long due to insufficient memory." << endl;
-                cout << "Exiting gracefully." << endl;
-                return; // Alternatively, call exit(0);
-            }
-            continue; // Skip the rest of the loop, nothing to do this iteration.
-        }
-        else
-        {
-            // Reset idle counter when we have activity.
-            idleIterationCount = 0;
-        }
-
-        checkIOQueueSimultaneously(ioQueue, readyQueue, totalCpuCycles);
-        if (!runningBlock)
-        {
-            if (readyQueue.empty() && !ioQueue.empty())
-            {
-                contextSwitch(totalCpuCycles, contextSwitchTime, "CPU idle with I/O waiting");
-                continue;
-            }
-            if (!readyQueue.empty())
-            {
-                runningBlock = readyQueue.front();
-                readyQueue.pop();
-                if (!firstProcessPicked)
-                {
-                    contextSwitch(totalCpuCycles, contextSwitchTime, "Initial context switch");
-                    firstProcessPicked = true;
-                }
-                else
-                {
-                    contextSwitch(totalCpuCycles, contextSwitchTime, "New process from ReadyQueue");
-                }
-                int procID = runningBlock->content[0];
-                int theStartTime = 0;
-                for (auto &proc : processes)
-                {
-                    if (proc.processID == procID)
-                    {
-                        if (proc.startTime == -1)
-                        {
-                            proc.startTime = totalCpuCycles;
-                        }
-                        theStartTime = proc.startTime;
-                        break;
-                    }
-                }
-
-                vector<MemBlock *> segBlocks;
-                for (size_t i = 0; i < processes.size(); i++)
-                {
-                    if (processes[i].processID == procID)
-                    {
-                        segBlocks = processes[i].segmentedBlocks; // found the matching process
-                        break;
-                    }
-                }
-
-                bool finished = executeProcess(runningBlock, totalCpuCycles, globalCPUAllocated, theStartTime, segBlocks);
-                if (!finished)
-                {
-                    if (runningBlock->content[1] == STATE_IO_WAITING)
-                    {
-                        ioQueue.push({runningBlock, totalCpuCycles + ioWaitTime});
-                    }
-                    else
-                    {
-                        readyQueue.push(runningBlock);
-                    }
-                }
-                else
-                {
-                    for (size_t i = 0; i < processes.size(); i++)
-                    {
-                        if (processes[i].processID == procID)
-                        {
-                            for (MemBlock *seg : processes[i].segmentedBlocks)
-                            {
-                                freeMemoryBlock(seg, segmentedMemory);
-                            }
-                            processes[i].segmentedBlocks.clear();
-                            break;
-                        }
-                    }
-                    cout << "Process " << procID << " terminated and freed memory blocks." << endl;
-
-                    loadWaitingJobs(newJobQueue, processes, logicalList, segmentedMemory, readyQueue);
-                }
-                runningBlock = nullptr;
-            }
-        }
-    }
-    contextSwitch(totalCpuCycles, contextSwitchTime, "Final context switch");
-    cout << "Total CPU time used: " << totalCpuCycles << ".\n";
-
-    flushLogs();
+    string workload((istreambuf_iterator<char>(cin)), istreambuf_iterator<char>());
+    // Both runs simulate for real: a cache hit would replay a stored result
+    // and make the wall times meaningless.
+    SimOptions sampledOptions = simOptions;
+    sampledOptions.resultCache.clear();
+    SimOptions fullOptions = sampledOptions;
+    fullOptions.sampleDetailed = 0;
+
+    RunResult results[2];
+    double seconds[2];
+    const SimOptions *options[2] = {&fullOptions, &sampledOptions};
+    for (int i = 0; i < 2; i++)
+    {
+        istringstream in(workload);
+        Simulator sim(*options[i]);
+        sim.loadWorkload(in);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        results[i] = sim.run();
+        seconds[i] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (!results[i].error.empty())
+        {
+            cout << "Error: " << results[i].error << endl;
+            return 1;
+        }
+    }
+
+    const RunResult &full = results[0];
+    const RunResult &sampled = results[1];
+    long long fullTime = full.counters.totalCpuTime;
+    long long sampledTime = sampled.counters.totalCpuTime;
+    cout << "----- Sampling Validation Report -----" << endl;
+    cout << "Wall time: full " << seconds[0] << "s, sampled " << seconds[1] << "s (speedup "
+         << (seconds[1] > 0 ? seconds[0] / seconds[1] : 0) << "x)" << endl;
+    cout << "Total CPU time: full " << fullTime << ", sampled " << sampledTime << " (error "
+         << (fullTime > 0 ? 100.0 * (sampledTime - fullTime) / fullTime : 0) << "%)" << endl;
+    cout << "Finished jobs: full " << full.counters.finishedJobs << ", sampled " << sampled.counters.finishedJobs
+         << endl;
+    printValidationLine("Throughput", full.throughput, sampled.throughput);
+    printValidationLine("Turnaround", full.turnaround, sampled.turnaround);
+    printValidationLine("Utilisation", full.utilisation, sampled.utilisation);
+    cout << "--------------------------------------" << endl;
+    return 0;
 }
 
-// -----------------------------------------------------------------------------
-// Main
-// -----------------------------------------------------------------------------
-int main()
+int main(int argc, char **argv)
 {
-    int maxMemory, numProcesses, globalCPUAllocated, contextSwitchTime;
-    vector<Process> processes = parseProcesses(maxMemory, numProcesses,
-                                               globalCPUAllocated,
-                                               contextSwitchTime);
-
-    // Initialize fakeMemory to size maxMemory with -1
-    physicalMemory.resize(maxMemory, -1);
-
-    MemBlock *logicalList = initDynamicMemory(maxMemory + 10000000);
-    MemBlock *segmentedMemory = initDynamicMemory(maxMemory);
-
-    queue<int> newJobQueue;
-    for (int i = 0; i < (int)processes.size(); i++)
-    {
-        newJobQueue.push(i);
-    }
-
-    queue<MemBlock *> readyQueue;
-    queue<pair<MemBlock *, int>> ioQueue;
-
-    schedulerLoop(readyQueue, ioQueue, newJobQueue, processes,
-                  globalCPUAllocated, contextSwitchTime, logicalList, segmentedMemory);
-
-    return 0;
+    SimOptions simOptions;
+    if (!parseCommandLine(argc, argv, simOptions))
+        return 1;
+    if (simOptions.sampleValidate)
+        return validateSampling(simOptions);
+    Simulator sim(simOptions, &cout);
+    if (simOptions.benchCore > 0)
+        return sim.benchmarkCore(simOptions.benchCore) ? 0 : 1;
+    if (simOptions.selfCheck)
+        return sim.selfCheck() ? 0 : 1;
+
+    sim.loadWorkload(cin);
+    const RunResult &result = sim.run();
+    for (const string &note : result.cacheNotes)
+        cerr << note << endl;
+    if (!result.error.empty())
+        return 1;
+    return result.cacheDrift ? 3 : 0;
 }
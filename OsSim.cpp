@@ -0,0 +1,6048 @@
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cmath>
+#include <chrono>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OSSIM_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OSSIM_SSE2 1
+#endif
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <unistd.h>
+#define OSSIM_CONTROL_SOCKET 1
+#endif
+#include "OsSim.h"
+#include "WorkloadGen.h"
+#include "Snapshot.h"
+using namespace std;
+
+namespace ossim
+{
+
+// -----------------------------------------------------------------------------
+// Process Structure and Constants
+// -----------------------------------------------------------------------------
+
+struct DecodedProgram;
+struct StagedJob;
+
+struct MemBlock
+{
+    int processID;
+    int start;
+    int size;
+    vector<int> content;
+    MemBlock *next;
+    // Cells of content written since the last sync to physicalMemory, one bit
+    // per cell. dirtyLo/dirtyHi bound the mask words that may be non-zero.
+    vector<uint64_t> dirtyMask;
+    int dirtyLo = 0;
+    int dirtyHi = -1;
+    // Load-time decoded form of the code in a contiguous execution block;
+    // dropped if a store ever overwrites the code it was built from.
+    shared_ptr<const DecodedProgram> decoded;
+};
+
+// One distinct program (instruction stream) in the workload. With
+// --share-code, processes whose instructions are identical point at the same
+// ProgramImage and share one read-only code segment in segmented memory.
+struct ProgramImage
+{
+    uint64_t hash = 0;
+    vector<int> instructions; // opcodes interleaved with operands
+    vector<int> instrList;    // opcodes only
+    vector<int> operandList;  // operands only
+    // Shared code segment (instrList then operandList) while any process
+    // using it is resident, and the number of such processes.
+    MemBlock *codeSegment = nullptr;
+    bool codeLoaded = false;
+    int residentUsers = 0;
+    // Decoded form shared by every process running this program.
+    shared_ptr<const DecodedProgram> decoded;
+
+    int codeSize() const { return (int)(instrList.size() + operandList.size()); }
+};
+
+// Owner ID of a shared code segment; free blocks use -1.
+const int SHARED_SEGMENT_OWNER = -2;
+
+const int PRESTAGE_NONE = 0;
+const int PRESTAGE_REQUESTED = 1; // handed to the stager
+const int PRESTAGE_COLLECTED = 2; // taken back at admission (staged or not)
+
+struct Process
+{
+    int processID;
+    int maxMemoryNeeded;
+    int numInstructions;
+    vector<int> instructions; // empty once the program is interned
+    shared_ptr<ProgramImage> program;
+    // True while the process maps its program's shared code segment.
+    bool sharesCode = false;
+    int startTime = -1;
+    // Cycle at which the job enters the system; 0 unless the workload sets one.
+    int arrivalTime = 0;
+    int finishTime = -1;
+    // NEW: save segmented memory blocks so we can free them on termination.
+    vector<MemBlock *> segmentedBlocks;
+    // Set while the segmented image is in the swap file instead of memory.
+    bool swappedOut = false;
+    long long swapOffset = -1; // first cell of its slot in the swap file
+    int swapCells = 0;
+    // What the stager built (see Job Pre-staging), held from admission until
+    // the images are built.
+    shared_ptr<const StagedJob> staged;
+    // The PCB as it was when the process terminated.
+    int exitProgramCounter = 0;
+    int exitRegister = 0;
+    int exitCpuCycles = 0;
+    // Fast-forwarded memory accesses made before the job arrived (sampling).
+    long long forwardAccessMark = 0;
+};
+
+// A job that has not been admitted yet. Its instructions are kept in jobArena
+// (see Queued Job Encoding); loadWaitingJobs builds the Process when the job
+// reaches the head of the NewJobQueue.
+struct QueuedJob
+{
+    int processID;
+    int maxMemoryNeeded;
+    int numInstructions;
+    int arrivalTime;
+    long long encodedOffset; // -1 once decoded, or for an interned program
+    int encodedBytes;
+    int cells; // instruction words
+    shared_ptr<ProgramImage> program;
+    long long forwardAccessMark;
+    int processIndex; // index in processes once built, else -1
+    int prestage;     // PRESTAGE_* (see Job Pre-staging)
+};
+
+const int STATE_NEW = 0;
+const int STATE_RUNNING = 1;
+const int STATE_IO_WAITING = 2;
+const int STATE_TERMINATED = 3;
+
+// Cell offsets of the PCB. A contiguous block starts with it; a segmented
+// image stores it right after the segment table.
+struct PCBLayout
+{
+    enum Field
+    {
+        ID = 0,
+        STATE = 1,
+        PC = 2,               // relative program counter
+        INSTRUCTION_BASE = 3, // relative
+        DATA_BASE = 4,        // relative
+        MEMORY_LIMIT = 5,
+        CPU_CYCLES = 6,
+        REGISTER = 7,
+        MAX_MEMORY = 8,
+        MAIN_MEMORY_BASE = 9,
+        SIZE = 10
+    };
+};
+
+// The instruction set: opcode numbers and how many operands each one takes.
+// Every parser, loader and the interpreter size operands from arity().
+struct BaseOpcodeSet
+{
+    enum Opcode
+    {
+        COMPUTE = 1,
+        PRINT = 2,
+        STORE = 3,
+        LOAD = 4
+    };
+    static constexpr bool extended = false;
+
+    static constexpr int arity(int opcode)
+    {
+        return (opcode == COMPUTE || opcode == STORE) ? 2 : (opcode == PRINT || opcode == LOAD) ? 1 : 0;
+    }
+};
+
+// Control flow and bulk memory on top of the base set. Jump targets are
+// instruction indices (the instruction count ends the program). LOOP
+// decrements the counter cell at a logical address and jumps while it stays
+// positive. MEMSET/MEMCPY work on logical ranges and cost one access per cell
+// read or written.
+//   5 JUMP target                 6 JUMP_IF_ZERO target (register == 0)
+//   7 JUMP_IF_NONZERO target      8 LOOP counterAddress target
+//   9 MEMSET value address count  10 MEMCPY source destination count
+struct ExtendedOpcodeSet : BaseOpcodeSet
+{
+    enum ExtendedOpcode
+    {
+        JUMP = 5,
+        JUMP_IF_ZERO = 6,
+        JUMP_IF_NONZERO = 7,
+        LOOP = 8,
+        MEMSET = 9,
+        MEMCPY = 10
+    };
+    static constexpr bool extended = true;
+
+    static constexpr int arity(int opcode)
+    {
+        return opcode <= LOAD ? BaseOpcodeSet::arity(opcode)
+               : opcode <= JUMP_IF_NONZERO ? 1
+               : opcode == LOOP ? 2
+               : opcode <= MEMCPY ? 3
+                                  : 0;
+    }
+};
+
+// Opcode numbers (the same in both sets). Which set is in force depends on
+// SimOptions::extendedOpcodes: the decoder and the execution core take it as
+// a template parameter, picked once per program or time slice; the parsers
+// and loaders go through opcodeArity().
+typedef ExtendedOpcodeSet Opcodes;
+
+inline int opcodeArity(int opcode, bool extended)
+{
+    return extended ? ExtendedOpcodeSet::arity(opcode) : BaseOpcodeSet::arity(opcode);
+}
+const int MAX_OPERANDS = 3;
+
+// Load-time decoded form of a program (see Instruction Decoding and Fusion).
+struct DecodedOp
+{
+    int opcode;
+    int a; // first operand (0 if none)
+    int b; // second operand (0 if none)
+    int c; // third operand (0 if none)
+};
+
+struct DecodedProgram
+{
+    vector<DecodedOp> ops;
+    // Cell of the first operand of each pc (size n + 1).
+    vector<int> operandOffset;
+    // Compute cycles of all compute instructions before each pc (size n + 1).
+    vector<long long> computePrefix;
+    // For each pc, the first pc at or after it that is not a compute instruction.
+    vector<int> runEnd;
+    // Cells [codeBegin, codeEnd) of the block were read to build this; a
+    // store into them invalidates the decoding.
+    int codeBegin = 0;
+    int codeEnd = 0;
+    // Prefix sums are only monotone when no compute cost is negative.
+    bool fusable = true;
+};
+
+// A queued job prepared ahead of admission: its instructions decoded from the
+// job arena, split into opcodes and operands, and, when its image fits its
+// reservation, the DecodedProgram loadJobIntoBlock would build.
+struct StagedJob
+{
+    vector<int> instructions;
+    vector<int> instrList;
+    vector<int> operandList;
+    bool blockDecoded = false;
+    shared_ptr<const DecodedProgram> decoded;
+};
+
+// Arrival events ordered by (arrivalTime, process index).
+typedef priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> ArrivalQueue;
+
+// Swallows everything written to it.
+class NullBuffer : public streambuf
+{
+protected:
+    int overflow(int c) { return traits_type::not_eof(c); }
+    streamsize xsputn(const char *, streamsize n) { return n; }
+};
+
+struct Simulator::Impl
+{
+    Impl(const SimOptions &options, ostream *output)
+        : simOptions(options), out(output ? output->rdbuf() : &discard)
+    {
+    }
+
+    // A Simulator may be dropped part way through a run (after step(), or
+    // when the run was abandoned), so stop whatever is still going and free
+    // every block, wherever it is held.
+    ~Impl()
+    {
+        for (thread &producer : producers)
+        {
+            if (producer.joinable())
+                producer.join();
+        }
+        loaderPool.stop();
+        jobStager.stop();
+        stopControlServer();
+        closeSwapFile();
+        for (MemBlock *block : ownedBlocks)
+            delete block;
+    }
+
+    SimOptions simOptions;
+    // Everything the run prints goes to out, which writes to the caller's
+    // stream or is discarded.
+    NullBuffer discard;
+    ostream out;
+    ostringstream logBuffer;
+    ostringstream freeListLog;
+    RunResult result;
+
+    void noteEvent(TimelineEventKind kind, int processID, long long cycle)
+    {
+        if (simOptions.recordTimeline)
+            result.timeline.push_back({cycle, processID, kind});
+    }
+
+    // -------------------------------------------------------------------------
+    // Host Timers
+    // -------------------------------------------------------------------------
+    // With --host-timers[=PATH] a ScopedTimer at the top of each subsystem entry
+    // point measures the wall-clock time of every call and records it in a
+    // log-linear histogram: 16 buckets per power of two, so any percentile is
+    // within about 6%. Timings are inclusive (admission includes the allocation
+    // and coalescing it does). The histograms are written to PATH as JSON at exit.
+
+    enum HostTimer
+    {
+        HOST_PARSE,
+        HOST_ADMISSION,
+        HOST_ALLOCATION,
+        HOST_COALESCE,
+        HOST_EXECUTE,
+        HOST_IO_POLL,
+        HOST_DUMP,
+        HOST_FLUSH,
+        HOST_TIMER_COUNT
+    };
+
+    const char *HOST_TIMER_NAMES[HOST_TIMER_COUNT] = {"parse", "admission", "allocation", "coalesce",
+                                                      "execute", "io_poll", "dump", "flush"};
+
+    class LatencyHistogram
+    {
+    public:
+        static const int SUB_BUCKETS = 16;
+
+        LatencyHistogram() : buckets(64 * SUB_BUCKETS, 0), count(0), total(0), maximum(0) {}
+
+        void record(uint64_t ns)
+        {
+            buckets[bucketOf(ns)]++;
+            count++;
+            total += ns;
+            maximum = max(maximum, ns);
+        }
+
+        // Upper bound of the bucket holding the p-quantile, capped at the maximum.
+        uint64_t percentile(double p) const
+        {
+            if (count == 0)
+                return 0;
+            uint64_t rank = (uint64_t)ceil(p * count);
+            if (rank < 1)
+                rank = 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < buckets.size(); i++)
+            {
+                seen += buckets[i];
+                if (seen >= rank)
+                    return min(upperBound((int)i), maximum);
+            }
+            return maximum;
+        }
+
+        uint64_t calls() const { return count; }
+        uint64_t totalNs() const { return total; }
+        uint64_t maxNs() const { return maximum; }
+
+    private:
+        static int bucketOf(uint64_t v)
+        {
+            if (v < SUB_BUCKETS)
+                return (int)v;
+            int e = 63;
+            while (!(v >> e))
+                e--;
+            return (e - 3) * SUB_BUCKETS + (int)((v >> (e - 4)) & (SUB_BUCKETS - 1));
+        }
+
+        static uint64_t upperBound(int index)
+        {
+            if (index < SUB_BUCKETS)
+                return (uint64_t)index;
+            int e = index / SUB_BUCKETS + 3;
+            uint64_t sub = (uint64_t)(index % SUB_BUCKETS);
+            return ((SUB_BUCKETS + sub) << (e - 4)) + ((uint64_t)1 << (e - 4)) - 1;
+        }
+
+        vector<uint64_t> buckets;
+        uint64_t count;
+        uint64_t total;
+        uint64_t maximum;
+    };
+
+    LatencyHistogram hostTimers[HOST_TIMER_COUNT];
+
+    // Null when --host-timers is off, so the ScopedTimer does nothing.
+    LatencyHistogram *hostTimer(HostTimer which)
+    {
+        return simOptions.hostTimers ? &hostTimers[which] : nullptr;
+    }
+
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(LatencyHistogram *histogram) : timer(histogram)
+        {
+            if (timer)
+                start = chrono::steady_clock::now();
+        }
+
+        ~ScopedTimer()
+        {
+            if (timer)
+                timer->record((uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+                                  chrono::steady_clock::now() - start)
+                                  .count());
+        }
+
+    private:
+        LatencyHistogram *timer;
+        chrono::steady_clock::time_point start;
+    };
+
+    bool writeHostTimers(const string &path)
+    {
+        ofstream out(path);
+        if (!out)
+            return false;
+        out << "{\n  \"unit\": \"ns\",\n  \"timers\": {";
+        for (int i = 0; i < HOST_TIMER_COUNT; i++)
+        {
+            const LatencyHistogram &h = hostTimers[i];
+            out << (i ? ",\n" : "\n") << "    \"" << HOST_TIMER_NAMES[i] << "\": {"
+                << "\"count\": " << h.calls()
+                << ", \"total\": " << h.totalNs()
+                << ", \"mean\": " << (h.calls() ? (double)h.totalNs() / h.calls() : 0.0)
+                << ", \"p50\": " << h.percentile(0.5)
+                << ", \"p99\": " << h.percentile(0.99)
+                << ", \"p999\": " << h.percentile(0.999)
+                << ", \"max\": " << h.maxNs() << "}";
+        }
+        out << "\n  }\n}\n";
+        return (bool)out;
+    }
+
+    // -------------------------------------------------------------------------
+    // CPU Clock and Context Switching
+    // -------------------------------------------------------------------------
+    void updateClock(int &totalCpuCycles, int increment, const string &)
+    {
+        totalCpuCycles += increment;
+    }
+
+    void contextSwitch(int &totalCpuCycles, int contextSwitchTime, const string &reason)
+    {
+        updateClock(totalCpuCycles, contextSwitchTime, reason);
+        result.counters.contextSwitches++;
+    }
+
+    // Debug: Print the free list with each block's start and size.
+    void printFreeList(MemBlock *list, const string &label, const string &)
+    {
+        out << "----- " << label << " -----" << endl;
+        out << "Calling function: " << endl;
+        if (!list)
+        {
+            out << "Free list is empty." << endl;
+        }
+        else
+        {
+            MemBlock *curr = list;
+            while (curr)
+            {
+                out << "Block Start: " << curr->start << ", Size: " << curr->size << endl;
+                curr = curr->next;
+            }
+        }
+        out << "---------------------" << endl;
+    }
+
+    // -------------------------------------------------------------------------
+    // Program Sharing
+    // -------------------------------------------------------------------------
+
+    // Distinct programs seen so far, by content hash. Each bucket holds the
+    // programs with that hash so a collision can never merge different code.
+    unordered_map<uint64_t, vector<shared_ptr<ProgramImage>>> programCache;
+
+    struct SharingStats
+    {
+        long long sharedAdmissions = 0; // admissions that mapped an already resident code segment
+        long long cellsSaved = 0;       // code cells those admissions did not allocate
+        long long copyOnWrites = 0;     // processes that wrote to their code and got a private copy
+        int peakSharedSegments = 0;
+        int residentSharedSegments = 0;
+    };
+
+    SharingStats sharingStats;
+
+    uint64_t hashInstructions(const vector<int> &instructions)
+    {
+        // FNV-1a over the 32-bit cells.
+        uint64_t h = 1469598103934665603ULL;
+        for (int v : instructions)
+        {
+            uint32_t u = (uint32_t)v;
+            for (int b = 0; b < 4; b++)
+            {
+                h ^= (u >> (8 * b)) & 0xFF;
+                h *= 1099511628211ULL;
+            }
+        }
+        return h;
+    }
+
+    // Split an interleaved instruction stream into opcodes and operands.
+    void splitInstructions(const vector<int> &instructions, vector<int> &instrList, vector<int> &operandList)
+    {
+        for (size_t i = 0; i < instructions.size();)
+        {
+            int opcode = instructions[i];
+            instrList.push_back(opcode);
+            int numOperands = opcodeArity(opcode, simOptions.extendedOpcodes);
+            for (int j = 0; j < numOperands; j++)
+            {
+                if ((i + 1) < instructions.size())
+                {
+                    operandList.push_back(instructions[i + 1]);
+                    i++;
+                }
+            }
+            i++;
+        }
+    }
+
+    // Point proc at the ProgramImage for its instructions, creating it on first use.
+    // The process's own copy of the instructions is released.
+    void internProgram(Process &proc)
+    {
+        uint64_t h = hashInstructions(proc.instructions);
+        vector<shared_ptr<ProgramImage>> &bucket = programCache[h];
+        for (const shared_ptr<ProgramImage> &image : bucket)
+        {
+            if (image->instructions == proc.instructions)
+            {
+                proc.program = image;
+                vector<int>().swap(proc.instructions);
+                return;
+            }
+        }
+        shared_ptr<ProgramImage> image = make_shared<ProgramImage>();
+        image->hash = h;
+        image->instructions.swap(proc.instructions);
+        splitInstructions(image->instructions, image->instrList, image->operandList);
+        bucket.push_back(image);
+        proc.program = image;
+    }
+
+    const vector<int> &processInstructions(const Process &proc)
+    {
+        return proc.program ? proc.program->instructions : proc.instructions;
+    }
+
+    // -------------------------------------------------------------------------
+    // Queued Job Encoding
+    // -------------------------------------------------------------------------
+    // Until it is admitted a job is only a QueuedJob in jobs, with its
+    // instructions in jobArena as zigzag varints (opcodes, small operands and -1
+    // take one byte each), or as plain cells with --no-compact-queue. An
+    // interned program keeps just its ProgramImage. loadWaitingJobs builds the
+    // Process when the job reaches the head of the NewJobQueue. Bytes of
+    // admitted jobs are reclaimed by compacting the arena once they make up
+    // most of it.
+
+    vector<QueuedJob> jobs; // input order, then submission order
+    string jobArena;
+    long long jobArenaDeadBytes = 0;
+
+    void queueJob(Process &proc)
+    {
+        QueuedJob job;
+        job.processID = proc.processID;
+        job.maxMemoryNeeded = proc.maxMemoryNeeded;
+        job.numInstructions = proc.numInstructions;
+        job.arrivalTime = proc.arrivalTime;
+        job.encodedOffset = -1;
+        job.encodedBytes = 0;
+        job.cells = (int)processInstructions(proc).size();
+        job.program = proc.program;
+        job.forwardAccessMark = proc.forwardAccessMark;
+        job.processIndex = -1;
+        job.prestage = PRESTAGE_NONE;
+        if (!proc.program)
+        {
+            job.encodedOffset = (long long)jobArena.size();
+            if (simOptions.compactQueue)
+            {
+                for (int value : proc.instructions)
+                    snapshot::putVarint(jobArena, snapshot::zigzag(value));
+            }
+            else
+            {
+                jobArena.append(reinterpret_cast<const char *>(proc.instructions.data()),
+                                proc.instructions.size() * sizeof(int));
+            }
+            job.encodedBytes = (int)((long long)jobArena.size() - job.encodedOffset);
+        }
+        jobs.push_back(std::move(job));
+    }
+
+    // Also runs on the stager thread; reads only the options.
+    void decodeJobCells(const char *bytes, int byteCount, int cells, vector<int> &instructions) const
+    {
+        instructions.resize(cells);
+        if (!simOptions.compactQueue)
+        {
+            if (cells > 0)
+                memcpy(instructions.data(), bytes, cells * sizeof(int));
+            return;
+        }
+        const uint8_t *p = (const uint8_t *)bytes;
+        const uint8_t *end = p + byteCount;
+        for (int i = 0; i < cells; i++)
+        {
+            uint64_t value = 0;
+            snapshot::getVarint(p, end, value);
+            instructions[i] = (int)snapshot::unzigzag(value);
+        }
+    }
+
+    // Build the Process for jobs[idx], taking its instructions from the
+    // stager if it has them, and append it to processes.
+    void buildQueuedJob(int idx)
+    {
+        QueuedJob &job = jobs[idx];
+        Process proc;
+        proc.processID = job.processID;
+        proc.maxMemoryNeeded = job.maxMemoryNeeded;
+        proc.numInstructions = job.numInstructions;
+        proc.arrivalTime = job.arrivalTime;
+        proc.program = job.program;
+        proc.forwardAccessMark = job.forwardAccessMark;
+        collectStagedJob(job, idx, proc);
+        if (job.encodedOffset >= 0)
+        {
+            if (!proc.staged)
+                decodeJobCells(jobArena.data() + job.encodedOffset, job.encodedBytes, job.cells, proc.instructions);
+            job.encodedOffset = -1;
+            jobArenaDeadBytes += job.encodedBytes;
+        }
+        job.processIndex = (int)processes.size();
+        processes.push_back(std::move(proc));
+    }
+
+    void compactJobArena()
+    {
+        if (jobArenaDeadBytes < (1 << 20) || jobArenaDeadBytes * 2 < (long long)jobArena.size())
+            return;
+        string live;
+        live.reserve(jobArena.size() - (size_t)jobArenaDeadBytes);
+        for (QueuedJob &job : jobs)
+        {
+            if (job.encodedOffset < 0)
+                continue;
+            long long offset = (long long)live.size();
+            live.append(jobArena, (size_t)job.encodedOffset, (size_t)job.encodedBytes);
+            job.encodedOffset = offset;
+        }
+        jobArena.swap(live);
+        jobArenaDeadBytes = 0;
+    }
+
+    // -------------------------------------------------------------------------
+    // Result Cache
+    // -------------------------------------------------------------------------
+    // With --result-cache=DIR the output of a run is stored under a key covering
+    // everything it depends on: the simulator version, the options, the header
+    // and every process record. A later run with the same key prints the stored
+    // output instead of simulating. An entry is two files in DIR:
+    //   <key>.out   the output, byte for byte
+    //   <key>.meta  version, options, output size and hash, and the run's metrics
+    // The .meta file is renamed into place last, so a half-written entry is never
+    // used. --verify-cache=P reruns P percent of hits and compares the output; on
+    // a mismatch the entry is replaced and the run exits with status 3.
+    // Runs whose input is not known up front (producers, control socket) or that
+    // write other files (snapshots, host timers) bypass the cache. Cache messages
+    // go to stderr so stdout is the same on a hit as on a miss.
+
+    // Build with -DOSSIM_VERSION=\"...\" to share a cache between builds of the
+    // same source; by default every build starts with an empty cache.
+#ifndef OSSIM_VERSION
+#define OSSIM_VERSION __DATE__ " " __TIME__
+#endif
+
+    // Two independent 64-bit hashes (FNV-1a and a multiply-xorshift), used
+    // together as a 128-bit key.
+    struct ContentHash
+    {
+        uint64_t a = 1469598103934665603ULL;
+        uint64_t b = 0x9E3779B97F4A7C15ULL;
+
+        void addByte(uint8_t byte)
+        {
+            a = (a ^ byte) * 1099511628211ULL;
+            b = (b ^ byte) * 0xBF58476D1CE4E5B9ULL;
+            b ^= b >> 29;
+        }
+
+        void addBytes(const char *data, size_t count)
+        {
+            for (size_t i = 0; i < count; i++)
+                addByte((uint8_t)data[i]);
+        }
+
+        void addValue(long long value)
+        {
+            for (int i = 0; i < 8; i++)
+                addByte((uint8_t)((uint64_t)value >> (8 * i)));
+        }
+
+        void addString(const string &text)
+        {
+            addValue((long long)text.size());
+            addBytes(text.data(), text.size());
+        }
+
+        string hex() const
+        {
+            char text[33];
+            snprintf(text, sizeof(text), "%016llx%016llx", (unsigned long long)a, (unsigned long long)b);
+            return text;
+        }
+    };
+
+    ContentHash resultKey;
+    string resultOptions; // the options in the key, as text
+    bool cachingResult = false;
+    bool verifyingResult = false;
+    string resultTmpSuffix = ".tmp"; // made unique per run so concurrent runs do not collide
+    string verifiedOutputHash;
+    long long verifiedOutputBytes = 0;
+
+    bool resultCacheUsable()
+    {
+        if (simOptions.resultCache.empty())
+            return false;
+        if (simOptions.producers > 0 || !simOptions.controlSocket.empty() || simOptions.snapshotEvery > 0 ||
+            simOptions.hostTimers)
+        {
+            noteCache("bypassed (the run has live input or writes other files)");
+            return false;
+        }
+        // The Prestage Report depends on how far the helper thread got, so
+        // the output differs between identical runs.
+        if (simOptions.prestageDepth > 0)
+        {
+            noteCache("bypassed (--prestage output is not deterministic)");
+            return false;
+        }
+        return true;
+    }
+
+    // Every option that can change the output, in a fixed order. Left out are
+    // options that only change how the host does the work (loader threads,
+    // the compact queue, file names) and those whose runs resultCacheUsable
+    // never caches (producers, control socket, snapshots, host timers,
+    // prestaging).
+    void hashResultOptions()
+    {
+        const SimOptions &o = simOptions;
+        stringstream text;
+        text << "latency=" << o.latencyReport << " zero=" << o.zeroOnFree << " placement=" << o.placement
+             << " segments=" << o.maxSegments << " share=" << o.shareCode << " fusion=" << o.fuseInstructions
+             << " extended=" << o.extendedOpcodes << "," << o.jumpLimit
+             << " banks=" << o.banks << " remote=" << o.remotePenalty << " local=" << o.bankLocal
+             << " memory-latency=" << o.memoryLatency << " flush=" << o.flushCacheOnSwitch << " swap=" << o.swapping
+             << "," << o.swapAfter << "," << o.swapLatency << "," << o.swapRate << " profile=" << o.profileMemory
+             << "," << o.profileWindow << " quantum=" << o.adaptiveQuantum << "," << o.quantumMin << ","
+             << o.quantumMax << " bank-latency=";
+        for (int latency : o.bankLatency)
+            text << latency << ",";
+        for (const IODeviceConfig &d : o.ioDevices)
+            text << " io=" << d.name << "," << d.discipline << "," << d.concurrency << "," << d.latency << ","
+                 << d.scale << "," << d.jitter << "," << d.tracks << "," << d.seekCost;
+        for (const CacheConfig &c : o.caches)
+            text << " cache=" << c.name << "," << c.size << "," << c.assoc << "," << c.line << "," << c.latency
+                 << "," << c.policy;
+        if (o.sampleDetailed > 0)
+            text << " sample=" << o.sampleDetailed << "," << o.sampleForward << "," << o.sampleWarmup;
+        resultOptions = text.str();
+        resultKey.addString(OSSIM_VERSION);
+        resultKey.addString(resultOptions);
+    }
+
+    void hashResultHeader(int maxMemory, int globalCPUAllocated, int contextSwitchTime)
+    {
+        resultKey.addValue(maxMemory);
+        resultKey.addValue(globalCPUAllocated);
+        resultKey.addValue(contextSwitchTime);
+    }
+
+    // Called before the record is interned or encoded, while proc.instructions is filled.
+    void hashResultRecord(const Process &proc, bool hasArrival)
+    {
+        resultKey.addValue(hasArrival ? proc.arrivalTime : -1);
+        resultKey.addValue(proc.processID);
+        resultKey.addValue(proc.maxMemoryNeeded);
+        resultKey.addValue(proc.numInstructions);
+        resultKey.addValue((long long)proc.instructions.size());
+        for (int value : proc.instructions)
+            resultKey.addValue(value);
+    }
+
+    string resultPath(const string &suffix)
+    {
+        return simOptions.resultCache + "/" + resultKey.hex() + suffix;
+    }
+
+    // Tees everything written to a stream into a temporary <key>.out while
+    // hashing it.
+    class OutputCapture : public streambuf
+    {
+    public:
+        OutputCapture() : stream(nullptr), target(nullptr), bytes(0) {}
+        ~OutputCapture() { detach(false); }
+
+        bool attach(const string &path, ostream &captured)
+        {
+            file.open(path.c_str(), ios::binary | ios::trunc);
+            if (!file)
+                return false;
+            filePath = path;
+            stream = &captured;
+            target = stream->rdbuf(this);
+            setp(buffer, buffer + sizeof(buffer));
+            return true;
+        }
+
+        // Restore the stream. Returns false if the capture file could not be
+        // written; the file is removed unless keep is set.
+        bool detach(bool keep)
+        {
+            if (!target)
+                return false;
+            drain();
+            stream->rdbuf(target);
+            target = nullptr;
+            file.close();
+            bool ok = !file.fail();
+            if (!keep || !ok)
+                remove(filePath.c_str());
+            return ok;
+        }
+
+        long long byteCount() const { return bytes; }
+        string hashHex() const { return hash.hex(); }
+
+    protected:
+        int overflow(int c) override
+        {
+            drain();
+            if (c != EOF)
+            {
+                *pptr() = (char)c;
+                pbump(1);
+            }
+            return c == EOF ? 0 : c;
+        }
+
+        int sync() override
+        {
+            drain();
+            return target->pubsync();
+        }
+
+    private:
+        void drain()
+        {
+            streamsize count = pptr() - pbase();
+            if (count > 0)
+            {
+                target->sputn(pbase(), count);
+                file.write(pbase(), count);
+                hash.addBytes(pbase(), (size_t)count);
+                bytes += count;
+            }
+            setp(buffer, buffer + sizeof(buffer));
+        }
+
+        ostream *stream;
+        streambuf *target;
+        ofstream file;
+        string filePath;
+        ContentHash hash;
+        long long bytes;
+        char buffer[1 << 16];
+    };
+
+    OutputCapture outputCapture;
+
+    struct CachedResult
+    {
+        long long bytes = -1;
+        string hash;
+        RunCounters counters;
+    };
+
+    // Read <key>.meta; false if it is missing or was written for another version or options.
+    bool readCachedResult(CachedResult &entry)
+    {
+        ifstream meta(resultPath(".meta").c_str());
+        string line;
+        bool versionMatches = false;
+        bool optionsMatch = false;
+        while (getline(meta, line))
+        {
+            size_t space = line.find(' ');
+            string field = line.substr(0, space);
+            string value = space == string::npos ? "" : line.substr(space + 1);
+            if (field == "version")
+                versionMatches = value == OSSIM_VERSION;
+            else if (field == "options")
+                optionsMatch = value == resultOptions;
+            else if (field == "output")
+            {
+                stringstream ss(value);
+                ss >> entry.bytes >> entry.hash;
+            }
+            else if (field == "counters")
+            {
+                stringstream ss(value);
+                ss >> entry.counters.totalCpuTime >> entry.counters.busyCycles >> entry.counters.contextSwitches >>
+                    entry.counters.processes >> entry.counters.finishedJobs;
+            }
+        }
+        if (!versionMatches || !optionsMatch || entry.bytes < 0)
+            return false;
+        // A damaged or truncated .out is a miss, not a wrong answer.
+        ifstream stored(resultPath(".out").c_str(), ios::binary);
+        ContentHash hash;
+        long long bytes = 0;
+        char chunk[1 << 16];
+        while (stored.read(chunk, sizeof(chunk)) || stored.gcount() > 0)
+        {
+            hash.addBytes(chunk, (size_t)stored.gcount());
+            bytes += stored.gcount();
+        }
+        return bytes == entry.bytes && hash.hex() == entry.hash;
+    }
+
+    // Result cache messages go to RunResult::cacheNotes, not into the output.
+    void noteCache(const string &message)
+    {
+        result.cacheNotes.push_back("Result cache: " + message);
+    }
+
+    void reportCachedCounters(const char *what, const RunCounters &counters)
+    {
+        stringstream text;
+        text << what << " " << resultKey.hex() << " (total CPU time " << counters.totalCpuTime << ", busy "
+             << counters.busyCycles << ", " << counters.finishedJobs << "/" << counters.processes
+             << " processes finished)";
+        noteCache(text.str());
+    }
+
+    // On a hit that is not picked for verification, print the stored output,
+    // take the stored counters and return true. Otherwise start capturing the
+    // output of the run.
+    bool replayCachedResult()
+    {
+        workload::Rng rng((uint64_t)chrono::steady_clock::now().time_since_epoch().count() ^ resultKey.a);
+        resultTmpSuffix = "." + to_string(rng.next() % 1000000000) + ".tmp";
+        CachedResult entry;
+        if (readCachedResult(entry))
+        {
+            verifyingResult = rng.range(0, 99) < simOptions.verifyCachePercent;
+            if (!verifyingResult)
+            {
+                ifstream stored(resultPath(".out").c_str(), ios::binary);
+                out << stored.rdbuf();
+                out.flush();
+                result.fromCache = true;
+                result.counters = entry.counters;
+                reportCachedCounters("hit", entry.counters);
+                return true;
+            }
+            verifiedOutputHash = entry.hash;
+            verifiedOutputBytes = entry.bytes;
+        }
+        if (!outputCapture.attach(resultPath(".out" + resultTmpSuffix), out))
+            noteCache("cannot write to " + simOptions.resultCache);
+        return false;
+    }
+
+    bool renameInto(const string &from, const string &to)
+    {
+        if (rename(from.c_str(), to.c_str()) == 0)
+            return true;
+        remove(to.c_str()); // rename does not replace on every platform
+        return rename(from.c_str(), to.c_str()) == 0;
+    }
+
+    // Stop capturing, compare with the stored output when verifying, and store
+    // the entry.
+    void storeResult()
+    {
+        if (!outputCapture.detach(true))
+            return;
+        long long bytes = outputCapture.byteCount();
+        string hash = outputCapture.hashHex();
+        const RunCounters &counters = result.counters;
+        if (verifyingResult)
+        {
+            if (bytes == verifiedOutputBytes && hash == verifiedOutputHash)
+            {
+                remove(resultPath(".out" + resultTmpSuffix).c_str());
+                reportCachedCounters("verified", counters);
+                return;
+            }
+            noteCache("drift in " + resultKey.hex() + ": stored " + to_string(verifiedOutputBytes) +
+                      " bytes, rerun wrote " + to_string(bytes) + " bytes; entry replaced");
+            result.cacheDrift = true;
+        }
+        {
+            ofstream meta(resultPath(".meta" + resultTmpSuffix).c_str());
+            meta << "version " << OSSIM_VERSION << "\n"
+                 << "options " << resultOptions << "\n"
+                 << "output " << bytes << " " << hash << "\n"
+                 << "counters " << counters.totalCpuTime << " " << counters.busyCycles << " "
+                 << counters.contextSwitches << " " << counters.processes << " " << counters.finishedJobs << "\n";
+        }
+        if (!renameInto(resultPath(".out" + resultTmpSuffix), resultPath(".out")) ||
+            !renameInto(resultPath(".meta" + resultTmpSuffix), resultPath(".meta")))
+        {
+            noteCache("cannot store " + resultKey.hex());
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // Process Input Parsing
+    // -------------------------------------------------------------------------
+    // Read one process record: [@arrival] processID maxMemoryNeeded
+    // numInstructions <opcode operands...>. Returns false if the record is cut short.
+    bool readProcessRecord(istream &in, Process &proc, bool &hasArrival)
+    {
+        // Optional "@<cycle>" prefix gives the job's arrival time.
+        in >> ws;
+        hasArrival = in.peek() == '@';
+        if (hasArrival)
+        {
+            in.get();
+            in >> proc.arrivalTime;
+        }
+        if (!(in >> proc.processID >> proc.maxMemoryNeeded >> proc.numInstructions))
+            return false;
+        proc.instructions.clear();
+        proc.instructions.reserve(proc.numInstructions * 3);
+
+        int instructionsRead = 0;
+        while (instructionsRead < proc.numInstructions)
+        {
+            int opcode;
+            if (!(in >> opcode))
+                return false;
+            proc.instructions.push_back(opcode);
+            instructionsRead++;
+
+            int numOperands = opcodeArity(opcode, simOptions.extendedOpcodes);
+            for (int j = 0; j < numOperands; j++)
+            {
+                int operand;
+                if (!(in >> operand))
+                    return false;
+                proc.instructions.push_back(operand);
+            }
+        }
+        return true;
+    }
+
+    // The first header or record starts the result cache key.
+    void beginWorkload()
+    {
+        if (workloadStarted)
+            return;
+        workloadStarted = true;
+        cachingResult = resultCacheUsable();
+        if (cachingResult)
+            hashResultOptions();
+    }
+
+    void setHeader(int memory, int quantum, int switchTime)
+    {
+        beginWorkload();
+        maxMemory = memory;
+        globalCPUAllocated = quantum;
+        contextSwitchTime = switchTime;
+        if (cachingResult)
+            hashResultHeader(maxMemory, globalCPUAllocated, contextSwitchTime);
+    }
+
+    void addProcess(Process proc, bool hasArrival)
+    {
+        beginWorkload();
+        if (hasArrival)
+            simOptions.latencyReport = true;
+        if (cachingResult)
+            hashResultRecord(proc, hasArrival);
+        if (simOptions.shareCode)
+            internProgram(proc);
+        queueJob(proc);
+    }
+
+    // Read the header and the process records. Returns false if the input
+    // ends early; the records read so far are kept.
+    bool parseProcesses(istream &in)
+    {
+        ScopedTimer timer(hostTimer(HOST_PARSE));
+        int memory = 0, quantum = 0, switchTime = 0, numProcesses = 0;
+        in >> memory >> quantum >> switchTime >> numProcesses;
+        bool complete = !in.fail();
+        setHeader(memory, quantum, switchTime);
+        jobs.reserve(jobs.size() + max(numProcesses, 0));
+
+        for (int p = 0; p < numProcesses; p++)
+        {
+            Process proc;
+            bool hasArrival;
+            if (!readProcessRecord(in, proc, hasArrival))
+                complete = false;
+            addProcess(std::move(proc), hasArrival);
+        }
+        return complete;
+    }
+
+    // -------------------------------------------------------------------------
+    // Job Submission
+    // -------------------------------------------------------------------------
+    // Jobs can also be submitted while the simulation runs. Any number of threads
+    // call submitJob(); the scheduler thread drains the queue in loadWaitingJobs.
+    // The queue is an intrusive multi-producer/single-consumer list: a producer
+    // swaps itself in as the tail with one atomic exchange and then links the old
+    // tail to it, and the consumer walks from a stub head. Neither side locks.
+    // A producer that has swapped the tail but not linked yet just makes its job
+    // visible on the next drain.
+    //
+    // Producers bracket their submissions with openJobSubmission() and
+    // closeJobSubmission(); the run does not end while a producer is open.
+
+    class JobSubmissionQueue
+    {
+    public:
+        JobSubmissionQueue() : head(&stub), tail(&stub), openProducers(0)
+        {
+            stub.next.store(nullptr, memory_order_relaxed);
+        }
+
+        ~JobSubmissionQueue()
+        {
+            Process job;
+            while (pop(job))
+            {
+            }
+        }
+
+        // Any thread.
+        void push(Process job)
+        {
+            Node *node = new Node();
+            node->job = std::move(job);
+            node->next.store(nullptr, memory_order_relaxed);
+            enqueue(node);
+        }
+
+        // Scheduler thread only. Returns false if nothing is visible yet.
+        bool pop(Process &job)
+        {
+            Node *first = head;
+            Node *next = first->next.load(memory_order_acquire);
+            if (first == &stub)
+            {
+                if (!next)
+                    return false;
+                head = next;
+                first = next;
+                next = next->next.load(memory_order_acquire);
+            }
+            if (!next)
+            {
+                // 'first' is the last node; put the stub behind it so it can be taken.
+                if (first != tail.load(memory_order_acquire))
+                    return false; // a producer is between its exchange and its link
+                stub.next.store(nullptr, memory_order_relaxed);
+                enqueue(&stub);
+                next = first->next.load(memory_order_acquire);
+                if (!next)
+                    return false;
+            }
+            head = next;
+            job = std::move(first->job);
+            delete first;
+            return true;
+        }
+
+        // Scheduler thread only: is a job (possibly) waiting?
+        bool hasWork() const
+        {
+            return head != &stub || stub.next.load(memory_order_acquire) != nullptr;
+        }
+
+        void openProducer() { openProducers.fetch_add(1, memory_order_relaxed); }
+        void closeProducer() { openProducers.fetch_sub(1, memory_order_release); }
+
+        // Jobs may still arrive: a producer is open or submissions are queued.
+        bool pending() const
+        {
+            return openProducers.load(memory_order_acquire) > 0 || hasWork();
+        }
+
+    private:
+        struct Node
+        {
+            Process job;
+            atomic<Node *> next;
+        };
+
+        void enqueue(Node *node)
+        {
+            Node *prev = tail.exchange(node, memory_order_acq_rel);
+            prev->next.store(node, memory_order_release);
+        }
+
+        Node *head; // consumer side
+        Node stub;
+        atomic<Node *> tail;
+        atomic<int> openProducers;
+    };
+
+    JobSubmissionQueue jobSubmission;
+
+    void openJobSubmission()
+    {
+        jobSubmission.openProducer();
+    }
+
+    void closeJobSubmission()
+    {
+        jobSubmission.closeProducer();
+    }
+
+    // Thread-safe. The job arrives when the scheduler next drains the queue.
+    void submitJob(Process job)
+    {
+        jobSubmission.push(std::move(job));
+    }
+
+    // Move up to 'batch' submitted jobs into jobs and the NewJobQueue,
+    // stamping their arrival with the current cycle.
+    int drainSubmittedJobs(deque<int> &newJobQueue, int now, int batch)
+    {
+        int drained = 0;
+        Process job;
+        while (drained < batch && jobSubmission.pop(job))
+        {
+            job.arrivalTime = now;
+            if (simOptions.shareCode)
+                internProgram(job);
+            noteEvent(EVENT_ARRIVED, job.processID, now);
+            job.forwardAccessMark = sampling.forwardAccesses;
+            queueJob(job);
+            newJobQueue.push_back((int)jobs.size() - 1);
+            drained++;
+        }
+        return drained;
+    }
+
+    // --producers=N: N threads generate jobs with WorkloadGen and submit them.
+    void runProducer(int index, int count, int maxMemory)
+    {
+        workload::GeneratorConfig cfg;
+        cfg.seed = 1000 + index;
+        cfg.numProcesses = count;
+        cfg.firstProcessID = 1000000 * (index + 1);
+        cfg.maxMemory = maxMemory;
+        cfg.memorySize = workload::Distribution(workload::DIST_UNIFORM, 50, max(50, maxMemory / 8));
+        workload::Generator gen(cfg);
+        workload::GeneratedProcess generated;
+        while (!gen.done())
+        {
+            gen.next(generated);
+            Process job;
+            job.processID = generated.processID;
+            job.maxMemoryNeeded = generated.maxMemoryNeeded;
+            job.numInstructions = generated.numInstructions;
+            job.instructions = generated.instructions;
+            submitJob(std::move(job));
+        }
+        closeJobSubmission();
+    }
+
+    vector<thread> startProducers(int maxMemory)
+    {
+        vector<thread> threads;
+        for (int i = 0; i < simOptions.producers; i++)
+        {
+            openJobSubmission(); // before the thread starts, so the run cannot end first
+            threads.push_back(thread(&Impl::runProducer, this, i, simOptions.jobsPerProducer, maxMemory));
+        }
+        return threads;
+    }
+
+    // -------------------------------------------------------------------------
+    // Bulk Memory Primitives
+    // -------------------------------------------------------------------------
+    // Simulated memory is moved around in runs of cells. These helpers do the
+    // copy/fill/compare on whole runs with SIMD and leave range checking to the
+    // caller, which clamps the count once instead of checking every cell.
+
+    void copyCells(int *dst, const int *src, size_t count)
+    {
+        size_t i = 0;
+#if defined(OSSIM_AVX2)
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+            _mm256_storeu_si256((__m256i *)(dst + i), v);
+        }
+#elif defined(OSSIM_SSE2)
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+            _mm_storeu_si128((__m128i *)(dst + i), v);
+        }
+#endif
+        for (; i < count; i++)
+            dst[i] = src[i];
+    }
+
+    // copyCells for ranges that may overlap.
+    void moveCells(int *dst, const int *src, size_t count)
+    {
+        if (dst > src && dst < src + count)
+            memmove(dst, src, count * sizeof(int));
+        else
+            copyCells(dst, src, count);
+    }
+
+    void fillCells(int *dst, int value, size_t count)
+    {
+        size_t i = 0;
+#if defined(OSSIM_AVX2)
+        __m256i v = _mm256_set1_epi32(value);
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_si256((__m256i *)(dst + i), v);
+#elif defined(OSSIM_SSE2)
+        __m128i v = _mm_set1_epi32(value);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_si128((__m128i *)(dst + i), v);
+#endif
+        for (; i < count; i++)
+            dst[i] = value;
+    }
+
+    // Returns the index of the first cell that differs, or count if equal.
+    size_t compareCells(const int *a, const int *b, size_t count)
+    {
+        size_t i = 0;
+#if defined(OSSIM_AVX2)
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+            __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+            unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(va, vb)));
+            if (mask != 0xFFu)
+                break;
+        }
+#elif defined(OSSIM_SSE2)
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(va, vb)) != 0xFFFF)
+                break;
+        }
+#endif
+        // Finish the tail, or pinpoint the mismatch inside the last vector.
+        for (; i < count; i++)
+        {
+            if (a[i] != b[i])
+                return i;
+        }
+        return count;
+    }
+
+    // --self-check compares the helpers above with plain loops: every start
+    // offset within a vector for both pointers, lengths 0-47 (so every tail of
+    // 0-15 cells after whole vectors) plus a few long runs, overlapping moves
+    // in both directions, and a mismatch at every position. Guard cells around
+    // each destination catch writes past either end. Returns the failures.
+    int runCellSelfCheck()
+    {
+        const int guard = 16;
+        const int value = 0x5A5A5A5A;
+        vector<size_t> lengths;
+        for (size_t n = 0; n < 48; n++)
+            lengths.push_back(n);
+        lengths.push_back(255);
+        lengths.push_back(1000);
+        lengths.push_back(1031);
+
+        long long cases[4] = {0, 0, 0, 0};
+        long long failures[4] = {0, 0, 0, 0};
+        for (size_t n : lengths)
+        {
+            size_t span = n + 2 * guard + 8;
+            vector<int> source(span), expected(span), actual(span);
+            for (size_t i = 0; i < span; i++)
+                source[i] = (int)(i * 2654435761u);
+            for (int dstOffset = 0; dstOffset < 8; dstOffset++)
+            {
+                int *dst = actual.data() + guard + dstOffset;
+                int *ref = expected.data() + guard + dstOffset;
+
+                // copyCells, from every source offset.
+                for (int srcOffset = 0; srcOffset < 8; srcOffset++)
+                {
+                    const int *src = source.data() + srcOffset;
+                    fill(expected.begin(), expected.end(), -1);
+                    fill(actual.begin(), actual.end(), -1);
+                    for (size_t i = 0; i < n; i++)
+                        ref[i] = src[i];
+                    copyCells(dst, src, n);
+                    cases[0]++;
+                    failures[0] += actual != expected;
+                }
+
+                // fillCells.
+                fill(expected.begin(), expected.end(), -1);
+                fill(actual.begin(), actual.end(), -1);
+                for (size_t i = 0; i < n; i++)
+                    ref[i] = value;
+                fillCells(dst, value, n);
+                cases[1]++;
+                failures[1] += actual != expected;
+
+                // moveCells within one buffer, the source up to 8 cells either
+                // side of the destination, so the ranges overlap when n > 0.
+                for (int shift = -8; shift <= 8; shift++)
+                {
+                    expected = source;
+                    actual = source;
+                    int *moveRef = expected.data() + guard + dstOffset;
+                    int *moveDst = actual.data() + guard + dstOffset;
+                    vector<int> saved(moveRef + shift, moveRef + shift + n);
+                    for (size_t i = 0; i < n; i++)
+                        moveRef[i] = saved[i];
+                    moveCells(moveDst, moveDst + shift, n);
+                    cases[2]++;
+                    failures[2] += actual != expected;
+                }
+
+                // compareCells: equal runs, then a mismatch at every position.
+                const int *a = source.data() + guard;
+                copyCells(dst, a, n);
+                cases[3]++;
+                failures[3] += compareCells(a, dst, n) != n;
+                for (size_t at = 0; at < n; at++)
+                {
+                    dst[at] = ~dst[at];
+                    cases[3]++;
+                    failures[3] += compareCells(a, dst, n) != at;
+                    dst[at] = ~dst[at];
+                }
+            }
+        }
+
+#if defined(OSSIM_AVX2)
+        const char *path = "AVX2";
+#elif defined(OSSIM_SSE2)
+        const char *path = "SSE2";
+#else
+        const char *path = "scalar";
+#endif
+        const char *names[4] = {"copyCells", "fillCells", "moveCells", "compareCells"};
+        long long failed = 0;
+        out << "----- Self Check -----" << endl;
+        out << "Bulk memory primitives: " << path << endl;
+        for (int i = 0; i < 4; i++)
+        {
+            out << names[i] << ": " << cases[i] << " cases, " << failures[i] << " failed" << endl;
+            failed += failures[i];
+        }
+        out << (failed == 0 ? "All checks passed." : "Self check FAILED.") << endl;
+        out << "----------------------" << endl;
+        return (int)failed;
+    }
+
+    // -------------------------------------------------------------------------
+    // Global fakeMemory array for printing physical addresses
+    // -------------------------------------------------------------------------
+    vector<int> physicalMemory; // Resized to maxMemory in startRun()
+
+    // -------------------------------------------------------------------------
+    // Memory Banks
+    // -------------------------------------------------------------------------
+    // Physical memory is split into --banks equal ranges. Segments never straddle
+    // a bank: the free list starts with one block per bank and is not coalesced
+    // across a boundary.
+
+    struct MemoryBank
+    {
+        int start = 0;
+        int size = 0;
+        int latency = 0;
+
+        // Statistics.
+        long long localAccesses = 0;
+        long long remoteAccesses = 0;
+        long long accessCycles = 0;
+        int usedCells = 0;
+        int peakUsedCells = 0;
+        double utilisationSum = 0; // sampled after every allocation and release
+        long long samples = 0;
+        int homedProcesses = 0;
+    };
+
+    vector<MemoryBank> memoryBanks;
+    long long bankLocalAllocations = 0;
+    long long bankSpilledAllocations = 0;
+
+    bool banksEnabled()
+    {
+        return memoryBanks.size() > 1;
+    }
+
+    void initMemoryBanks(int maxMemory)
+    {
+        int count = max(1, min(simOptions.banks, maxMemory));
+        memoryBanks.assign(count, MemoryBank());
+        int start = 0;
+        for (int i = 0; i < count; i++)
+        {
+            MemoryBank &bank = memoryBanks[i];
+            bank.start = start;
+            bank.size = maxMemory / count + (i < maxMemory % count ? 1 : 0);
+            if (!simOptions.bankLatency.empty())
+                bank.latency = simOptions.bankLatency[min(i, (int)simOptions.bankLatency.size() - 1)];
+            start += bank.size;
+        }
+    }
+
+    int bankOf(int address)
+    {
+        for (int i = (int)memoryBanks.size() - 1; i > 0; i--)
+        {
+            if (address >= memoryBanks[i].start)
+                return i;
+        }
+        return 0;
+    }
+
+    // Cycles charged for one store/load of 'address' by a process whose segment
+    // table lives in 'homeBank'. A flat memory keeps the original one cycle.
+    int chargeBankAccess(int address, int homeBank)
+    {
+        if (!banksEnabled() || address < 0)
+            return 1;
+        MemoryBank &bank = memoryBanks[bankOf(address)];
+        int cycles = 1 + bank.latency;
+        if (&bank == &memoryBanks[homeBank])
+        {
+            bank.localAccesses++;
+        }
+        else
+        {
+            bank.remoteAccesses++;
+            cycles += simOptions.remotePenalty;
+        }
+        bank.accessCycles += cycles;
+        return cycles;
+    }
+
+    // Recompute per-bank usage from the segmented free list.
+    void sampleBankUsage(MemBlock *segmentedMemory)
+    {
+        if (!banksEnabled())
+            return;
+        vector<int> freeCells(memoryBanks.size(), 0);
+        for (MemBlock *iter = segmentedMemory; iter != nullptr; iter = iter->next)
+        {
+            if (iter->processID == -1)
+                freeCells[bankOf(iter->start)] += iter->size;
+        }
+        for (size_t i = 0; i < memoryBanks.size(); i++)
+        {
+            MemoryBank &bank = memoryBanks[i];
+            bank.usedCells = bank.size - freeCells[i];
+            bank.peakUsedCells = max(bank.peakUsedCells, bank.usedCells);
+            bank.utilisationSum += bank.size > 0 ? (double)bank.usedCells / bank.size : 0;
+            bank.samples++;
+        }
+    }
+
+    // Count a finished allocation as bank-local or spilled across banks.
+    void noteBankAllocation(const vector<MemBlock *> &segments, MemBlock *segmentedMemory)
+    {
+        if (!banksEnabled() || segments.empty())
+            return;
+        int home = bankOf(segments[0]->start);
+        bool local = true;
+        for (MemBlock *seg : segments)
+            local = local && bankOf(seg->start) == home;
+        (local ? bankLocalAllocations : bankSpilledAllocations)++;
+        memoryBanks[home].homedProcesses++;
+        sampleBankUsage(segmentedMemory);
+    }
+
+    // -------------------------------------------------------------------------
+    // Cache Model
+    // -------------------------------------------------------------------------
+    // Set-associative caches indexed by the translated physical address. Every
+    // level a store/load probes adds its latency; a line that misses everywhere
+    // is fetched from its memory bank and filled into every level.
+
+    struct CacheLevel
+    {
+        CacheConfig config;
+        int sets = 1;
+        vector<long long> lines;  // sets * assoc line addresses, -1 = invalid
+        vector<long long> stamps; // LRU: last use of each way
+        vector<uint8_t> plruBits; // PLRU: assoc - 1 tree bits per set
+        long long tick = 0;
+        long long hits = 0;
+        long long misses = 0;
+
+        explicit CacheLevel(const CacheConfig &cfg) : config(cfg)
+        {
+            sets = max(1, config.size / (config.assoc * config.line));
+            lines.assign((size_t)sets * config.assoc, -1);
+            stamps.assign(lines.size(), 0);
+            plruBits.assign((size_t)sets * max(1, config.assoc - 1), 0);
+        }
+
+        void flush()
+        {
+            fill(lines.begin(), lines.end(), -1);
+            fill(stamps.begin(), stamps.end(), 0);
+            fill(plruBits.begin(), plruBits.end(), 0);
+        }
+
+        // Point every tree node on the way to 'way' away from it.
+        void plruTouch(int set, int way)
+        {
+            uint8_t *bits = &plruBits[(size_t)set * max(1, config.assoc - 1)];
+            int node = 0, low = 0, span = config.assoc;
+            while (span > 1)
+            {
+                span /= 2;
+                bool right = way >= low + span;
+                bits[node] = right ? 0 : 1;
+                if (right)
+                    low += span;
+                node = 2 * node + (right ? 2 : 1);
+            }
+        }
+
+        int plruVictim(int set)
+        {
+            const uint8_t *bits = &plruBits[(size_t)set * max(1, config.assoc - 1)];
+            int node = 0, low = 0, span = config.assoc;
+            while (span > 1)
+            {
+                span /= 2;
+                bool right = bits[node] != 0;
+                if (right)
+                    low += span;
+                node = 2 * node + (right ? 2 : 1);
+            }
+            return low;
+        }
+
+        // Look up the line holding 'address'; on a miss it is filled.
+        bool access(int address)
+        {
+            long long lineAddr = address / config.line;
+            int set = (int)(lineAddr % sets);
+            size_t base = (size_t)set * config.assoc;
+            tick++;
+            int way = -1;
+            for (int w = 0; w < config.assoc; w++)
+            {
+                if (lines[base + w] == lineAddr)
+                {
+                    way = w;
+                    break;
+                }
+            }
+            bool hit = way != -1;
+            if (hit)
+            {
+                hits++;
+            }
+            else
+            {
+                misses++;
+                for (int w = 0; w < config.assoc && way == -1; w++)
+                {
+                    if (lines[base + w] == -1)
+                        way = w;
+                }
+                if (way == -1 && config.policy == CACHE_PLRU)
+                    way = plruVictim(set);
+                if (way == -1)
+                {
+                    way = 0;
+                    for (int w = 1; w < config.assoc; w++)
+                    {
+                        if (stamps[base + w] < stamps[base + way])
+                            way = w;
+                    }
+                }
+                lines[base + way] = lineAddr;
+            }
+            stamps[base + way] = tick;
+            if (config.policy == CACHE_PLRU)
+                plruTouch(set, way);
+            return hit;
+        }
+    };
+
+    struct ProcessCacheStats
+    {
+        long long accesses = 0;
+        vector<long long> misses; // per level
+    };
+
+    vector<CacheLevel> cacheLevels;
+    unordered_map<int, ProcessCacheStats> processCacheStats;
+    long long cacheFlushes = 0;
+    int lastCachedProcess = -1;
+
+    bool cachesEnabled()
+    {
+        return !cacheLevels.empty();
+    }
+
+    void initCaches()
+    {
+        cacheLevels.clear();
+        for (const CacheConfig &cfg : simOptions.caches)
+            cacheLevels.push_back(CacheLevel(cfg));
+    }
+
+    // Called when a process is dispatched; flushes on a change of process if asked to.
+    void switchCacheContext(int processID)
+    {
+        if (cachesEnabled() && simOptions.flushCacheOnSwitch && processID != lastCachedProcess)
+        {
+            for (CacheLevel &level : cacheLevels)
+                level.flush();
+            cacheFlushes++;
+        }
+        lastCachedProcess = processID;
+    }
+
+    // Cycles charged for one store/load of a physical address. Without caches
+    // this is the bank cost alone (one cycle for a flat memory).
+    int chargeMemoryAccess(int address, int homeBank, int processID)
+    {
+        if (!cachesEnabled() || address < 0)
+            return chargeBankAccess(address, homeBank);
+        ProcessCacheStats &stats = processCacheStats[processID];
+        if (stats.misses.empty())
+            stats.misses.assign(cacheLevels.size(), 0);
+        stats.accesses++;
+        int cycles = 0;
+        for (size_t i = 0; i < cacheLevels.size(); i++)
+        {
+            cycles += cacheLevels[i].config.latency;
+            if (cacheLevels[i].access(address))
+            {
+                return cycles; // the levels above filled the line on their miss
+            }
+            stats.misses[i]++;
+        }
+        return cycles + simOptions.memoryLatency + chargeBankAccess(address, homeBank);
+    }
+
+    void printCacheReport(const vector<QueuedJob> &jobs)
+    {
+        out << "----- Cache Report -----" << endl;
+        for (const CacheLevel &level : cacheLevels)
+        {
+            long long accesses = level.hits + level.misses;
+            out << level.config.name << " (" << level.config.size << " cells, " << level.config.assoc
+                 << "-way, line " << level.config.line << ", "
+                 << (level.config.policy == CACHE_PLRU ? "PLRU" : "LRU") << ")"
+                 << ": accesses " << accesses
+                 << ", hits " << level.hits
+                 << ", misses " << level.misses
+                 << ", miss rate " << (accesses ? (double)level.misses / accesses : 0.0) << endl;
+        }
+        if (simOptions.flushCacheOnSwitch)
+            out << "Flushes on context switch: " << cacheFlushes << endl;
+        for (const QueuedJob &job : jobs)
+        {
+            auto it = processCacheStats.find(job.processID);
+            if (it == processCacheStats.end())
+                continue;
+            const ProcessCacheStats &stats = it->second;
+            out << "Process " << job.processID << ": accesses " << stats.accesses;
+            long long probes = stats.accesses;
+            for (size_t i = 0; i < cacheLevels.size(); i++)
+            {
+                out << ", " << cacheLevels[i].config.name << " miss rate "
+                     << (probes ? (double)stats.misses[i] / probes : 0.0);
+                probes = stats.misses[i];
+            }
+            out << endl;
+        }
+        out << "------------------------" << endl;
+    }
+
+    void printBankReport()
+    {
+        out << "----- Memory Bank Report -----" << endl;
+        for (size_t i = 0; i < memoryBanks.size(); i++)
+        {
+            const MemoryBank &bank = memoryBanks[i];
+            long long accesses = bank.localAccesses + bank.remoteAccesses;
+            double peak = bank.size ? (double)bank.peakUsedCells / bank.size : 0.0;
+            double mean = bank.samples ? bank.utilisationSum / bank.samples : 0.0;
+            out << "Bank " << i << " [" << bank.start << ", " << bank.start + bank.size - 1 << "]"
+                 << ": latency " << bank.latency
+                 << ", peak utilisation " << peak
+                 << ", mean utilisation " << mean
+                 << ", processes homed " << bank.homedProcesses
+                 << ", accesses " << accesses
+                 << ", remote accesses " << bank.remoteAccesses
+                 << ", access cycles " << bank.accessCycles << endl;
+        }
+        out << "Allocations within one bank: " << bankLocalAllocations
+             << ", spread across banks: " << bankSpilledAllocations << endl;
+        out << "------------------------------" << endl;
+    }
+
+    // -------------------------------------------------------------------------
+    // Memory System
+    // -------------------------------------------------------------------------
+
+    // Every MemBlock the simulator has allocated and not merged away. Blocks
+    // move between free lists, queues and processes, so ~Impl frees them from
+    // here rather than chasing each holder.
+    unordered_set<MemBlock *> ownedBlocks;
+
+    MemBlock *newBlock()
+    {
+        MemBlock *block = new MemBlock();
+        ownedBlocks.insert(block);
+        return block;
+    }
+
+    void deleteBlock(MemBlock *block)
+    {
+        ownedBlocks.erase(block);
+        delete block;
+    }
+
+    MemBlock *initDynamicMemory(int maxMemory)
+    {
+        MemBlock *head = newBlock();
+        head->processID = -1;
+        head->start = 0;
+        head->size = maxMemory;
+        head->next = nullptr;
+        return head;
+    }
+
+    // Segmented memory starts as one free block per bank.
+    MemBlock *initBankedMemory(int maxMemory)
+    {
+        MemBlock *head = nullptr;
+        for (int i = (int)memoryBanks.size() - 1; i >= 0; i--)
+        {
+            MemBlock *block = initDynamicMemory(memoryBanks[i].size);
+            block->start = memoryBanks[i].start;
+            block->next = head;
+            head = block;
+        }
+        return head ? head : initDynamicMemory(maxMemory);
+    }
+
+    // Insert a free block in ascending 'start'
+    void insertFreeBlock(MemBlock *block, MemBlock *&logicalList)
+    {
+        if (!logicalList || block->start < logicalList->start)
+        {
+            block->next = logicalList;
+            logicalList = block;
+            return;
+        }
+        MemBlock *curr = logicalList;
+        while (curr->next && curr->next->start < block->start)
+        {
+            curr = curr->next;
+        }
+        block->next = curr->next;
+        curr->next = block;
+    }
+
+    // Coalesce adjacent free blocks; with keepBanks, never across a bank boundary.
+    void coalesceFreeList(MemBlock *&logicalList, bool keepBanks = false)
+    {
+        ScopedTimer timer(hostTimer(HOST_COALESCE));
+
+        if (!logicalList)
+            return;
+        MemBlock *curr = logicalList;
+
+        while (curr && curr->next)
+        {
+            if (curr->start + curr->size == curr->next->start &&
+                (!keepBanks || bankOf(curr->start) == bankOf(curr->next->start)))
+            {
+                MemBlock *temp = curr->next;
+                curr->size += temp->size;
+                curr->next = temp->next;
+                deleteBlock(temp);
+            }
+            else
+            {
+                curr = curr->next;
+            }
+        }
+    }
+
+    // Freed memory => insert inlogical WITHOUT coalescing
+    void freeMemoryBlock(MemBlock *block, MemBlock *&logicalList)
+    {
+        int startAddr = block->start;
+        int endAddr = block->start + block->size - 1;
+        int procID = block->processID;
+        block->processID = -1;
+        if (simOptions.zeroOnFree)
+        {
+            if (startAddr >= 0 && endAddr < (int)physicalMemory.size())
+                fillCells(&physicalMemory[startAddr], 0, block->size);
+            if (!block->content.empty())
+                fillCells(block->content.data(), 0, block->content.size());
+        }
+        insertFreeBlock(block, logicalList);
+    }
+
+    // Record that content[index] of a segment no longer matches physicalMemory.
+    void markCellDirty(MemBlock *seg, int index)
+    {
+        // Blocks are reused and coalesced, so size the mask to the current content.
+        size_t words = (seg->content.size() + 63) / 64;
+        if (seg->dirtyMask.size() < words)
+            seg->dirtyMask.resize(words, 0);
+        int word = index >> 6;
+        seg->dirtyMask[word] |= (uint64_t)1 << (index & 63);
+        if (seg->dirtyHi < seg->dirtyLo)
+        {
+            seg->dirtyLo = word;
+            seg->dirtyHi = word;
+        }
+        else
+        {
+            seg->dirtyLo = min(seg->dirtyLo, word);
+            seg->dirtyHi = max(seg->dirtyHi, word);
+        }
+    }
+
+    // Record that content[index, index + count) no longer matches physicalMemory.
+    void markRunDirty(MemBlock *seg, int index, int count)
+    {
+        if (count <= 0)
+            return;
+        size_t words = (seg->content.size() + 63) / 64;
+        if (seg->dirtyMask.size() < words)
+            seg->dirtyMask.resize(words, 0);
+        int first = index >> 6;
+        int last = (index + count - 1) >> 6;
+        for (int word = first; word <= last; word++)
+        {
+            int lo = word == first ? (index & 63) : 0;
+            int hi = word == last ? ((index + count - 1) & 63) : 63;
+            uint64_t upTo = hi == 63 ? ~(uint64_t)0 : ((uint64_t)1 << (hi + 1)) - 1;
+            seg->dirtyMask[word] |= upTo & ~(((uint64_t)1 << lo) - 1);
+        }
+        if (seg->dirtyHi < seg->dirtyLo)
+        {
+            seg->dirtyLo = first;
+            seg->dirtyHi = last;
+        }
+        else
+        {
+            seg->dirtyLo = min(seg->dirtyLo, first);
+            seg->dirtyHi = max(seg->dirtyHi, last);
+        }
+    }
+
+    // Write one cell of the process image held in its segments. imageIndex counts
+    // from the start of the segment table, the same order loadJobIntoSegments lays
+    // the image out in. Unchanged values are not marked dirty.
+    void writeSegmentCell(const vector<MemBlock *> &segBlocks, int imageIndex, int value)
+    {
+        int remaining = imageIndex;
+        for (MemBlock *seg : segBlocks)
+        {
+            if (remaining < (int)seg->content.size())
+            {
+                // Shared code is read-only; resolveCopyOnWrite makes a private copy.
+                if (seg->processID == SHARED_SEGMENT_OWNER)
+                    return;
+                if (seg->content[remaining] != value)
+                {
+                    seg->content[remaining] = value;
+                    markCellDirty(seg, remaining);
+                }
+                return;
+            }
+            remaining -= (int)seg->content.size();
+        }
+    }
+
+    // writeSegmentCell for 'count' consecutive cells.
+    void writeSegmentRun(const vector<MemBlock *> &segBlocks, int imageIndex, const int *values, int count)
+    {
+        int remaining = imageIndex;
+        for (MemBlock *seg : segBlocks)
+        {
+            if (count <= 0)
+                return;
+            int size = (int)seg->content.size();
+            if (remaining >= size)
+            {
+                remaining -= size;
+                continue;
+            }
+            int run = min(count, size - remaining);
+            if (seg->processID != SHARED_SEGMENT_OWNER)
+            {
+                copyCells(seg->content.data() + remaining, values, run);
+                markRunDirty(seg, remaining, run);
+            }
+            values += run;
+            count -= run;
+            remaining = 0;
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // Instruction Decoding and Fusion
+    // -------------------------------------------------------------------------
+    // When a job is loaded its code is decoded once: operands are resolved per
+    // instruction and every run of consecutive compute instructions becomes a
+    // superinstruction with precomputed cycle prefix sums. executeProcess retires
+    // a whole run with one clock update and one write of its "compute" lines, and
+    // uses the prefix sums to stop at exactly the instruction where the
+    // instruction-at-a-time loop would raise the TimeOUT interrupt.
+
+    // Decode the code of a contiguous block laid out by loadJobIntoBlock.
+    shared_ptr<const DecodedProgram> decodeBlockProgram(const vector<int> &mem)
+    {
+        return simOptions.extendedOpcodes ? decodeProgram<ExtendedOpcodeSet>(mem) : decodeProgram<BaseOpcodeSet>(mem);
+    }
+
+    template <class Ops>
+    shared_ptr<const DecodedProgram> decodeProgram(const vector<int> &mem)
+    {
+        shared_ptr<DecodedProgram> prog = make_shared<DecodedProgram>();
+        int instructionBase = mem[PCBLayout::INSTRUCTION_BASE];
+        int dataBase = mem[PCBLayout::DATA_BASE];
+        int n = dataBase - instructionBase;
+        int operandPointer = dataBase;
+        prog->ops.resize(n);
+        prog->operandOffset.assign(n + 1, dataBase);
+        prog->computePrefix.assign(n + 1, 0);
+        prog->runEnd.assign(n + 1, n);
+        for (int pc = 0; pc < n; pc++)
+        {
+            DecodedOp &op = prog->ops[pc];
+            prog->operandOffset[pc] = operandPointer;
+            op.opcode = mem[instructionBase + pc];
+            op.a = 0;
+            op.b = 0;
+            op.c = 0;
+            int arity = Ops::arity(op.opcode);
+            if (arity >= 1)
+                op.a = operandPointer < (int)mem.size() ? mem[operandPointer] : 0;
+            if (arity >= 2)
+                op.b = operandPointer + 1 < (int)mem.size() ? mem[operandPointer + 1] : 0;
+            if (arity >= 3)
+                op.c = operandPointer + 2 < (int)mem.size() ? mem[operandPointer + 2] : 0;
+            operandPointer += arity;
+            if (operandPointer > (int)mem.size())
+                return nullptr; // operands run off the block; leave it to the interpreter
+            prog->operandOffset[pc + 1] = operandPointer;
+            prog->computePrefix[pc + 1] = prog->computePrefix[pc] + (op.opcode == Opcodes::COMPUTE ? op.b : 0);
+            if (op.opcode == Opcodes::COMPUTE && op.b < 0)
+                prog->fusable = false;
+        }
+        for (int pc = n - 1; pc >= 0; pc--)
+            prog->runEnd[pc] = prog->ops[pc].opcode == Opcodes::COMPUTE ? prog->runEnd[pc + 1] : pc;
+        prog->codeBegin = instructionBase;
+        prog->codeEnd = operandPointer;
+        return prog;
+    }
+
+    // Write 'count' copies of "compute\n" and flush once, the same bytes the
+    // interpreter produces one line at a time.
+    void printComputeLines(long long count)
+    {
+        static const string lines = []()
+        {
+            string text;
+            for (int i = 0; i < 64; i++)
+                text += "compute\n";
+            return text;
+        }();
+        while (count > 0)
+        {
+            long long chunk = min<long long>(count, 64);
+            out.write(lines.data(), (streamsize)(chunk * 8));
+            count -= chunk;
+        }
+        out.flush();
+    }
+
+    // -------------------------------------------------------------------------
+    // Allocation and Loading
+    // -------------------------------------------------------------------------
+
+    // Helper function to print the new job queue.
+    void printNewJobQueue(deque<int> newJobQueue)
+    {
+        out << "----- New Job Queue Contents -----" << endl;
+        if (newJobQueue.empty())
+        {
+            out << "New Job Queue is empty." << endl;
+        }
+        while (!newJobQueue.empty())
+        {
+            int idx = newJobQueue.front();
+            newJobQueue.pop_front();
+            // Print the process index and its process ID (or any other info you want)
+            out << "Queue Entry - Index: " << idx
+                 << ", Process ID: " << jobs[idx].processID << endl;
+        }
+        out << "----------------------------------" << endl;
+    }
+
+    MemBlock *allocateMemoryForJob(MemBlock *&logicalList, Process &job)
+    {
+        int requiredSize = 10 + job.maxMemoryNeeded;
+        MemBlock *current = logicalList;
+        MemBlock *prev = nullptr;
+
+        while (current)
+        {
+            if (current->processID == -1 && current->size >= requiredSize)
+            {
+                if (current->size == requiredSize)
+                {
+                    if (!prev)
+                    {
+                        logicalList = current->next;
+                    }
+                    else
+                    {
+                        prev->next = current->next;
+                    }
+                    current->next = nullptr;
+                    current->processID = job.processID;
+                    current->content.resize(requiredSize, 0);
+                    return current;
+                }
+                else
+                {
+                    MemBlock *allocated = newBlock();
+                    allocated->processID = job.processID;
+                    allocated->start = current->start;
+                    allocated->size = requiredSize;
+                    allocated->content.resize(requiredSize, 0);
+                    current->start += requiredSize;
+                    current->size -= requiredSize;
+                    return allocated;
+                }
+            }
+            prev = current;
+            current = current->next;
+        }
+        return nullptr;
+    }
+
+    bool loadJobIntoBlock(const Process &proc, MemBlock *block)
+    {
+        // A staged job was split ahead of admission.
+        vector<int> splitInstr;
+        vector<int> splitOperands;
+        if (!proc.staged)
+            splitInstructions(processInstructions(proc), splitInstr, splitOperands);
+        const vector<int> &instrList = proc.staged ? proc.staged->instrList : splitInstr;
+        const vector<int> &operandList = proc.staged ? proc.staged->operandList : splitOperands;
+
+        int instructionCount = (int)instrList.size();
+        int operandCount = (int)operandList.size();
+        int totalMem = proc.maxMemoryNeeded;
+        int remainData = totalMem - (instructionCount + operandCount);
+
+        if (remainData < 0)
+        {
+            out << "Error: Process " << proc.processID
+                 << " requires more memory than allocated!" << endl;
+            return false;
+        }
+
+        // Setup PCB in block->content (all stored as relative values)
+        int *pcb = block->content.data();
+        pcb[PCBLayout::ID] = proc.processID;
+        pcb[PCBLayout::STATE] = STATE_RUNNING;
+        pcb[PCBLayout::PC] = 0;
+        pcb[PCBLayout::INSTRUCTION_BASE] = PCBLayout::SIZE;
+        pcb[PCBLayout::DATA_BASE] = PCBLayout::SIZE + instructionCount;
+        pcb[PCBLayout::MEMORY_LIMIT] = totalMem;
+        pcb[PCBLayout::CPU_CYCLES] = 0;
+        pcb[PCBLayout::REGISTER] = 0;
+        pcb[PCBLayout::MAX_MEMORY] = totalMem; // duplicate memory limit
+        pcb[PCBLayout::MAIN_MEMORY_BASE] = block->start;
+
+        // Copy instructions and operands into block->content, clamped once to
+        // the block size.
+        int capacity = (int)block->content.size();
+        int instrIndex = 10;
+        int instrCopy = max(0, min(instructionCount, capacity - instrIndex));
+        copyCells(block->content.data() + instrIndex, instrList.data(), instrCopy);
+        int dataIndex = min(10 + instructionCount, capacity);
+        int operandCopy = max(0, min(operandCount, capacity - dataIndex));
+        copyCells(block->content.data() + dataIndex, operandList.data(), operandCopy);
+        dataIndex += operandCopy;
+        int fillCount = max(0, min(remainData, capacity - dataIndex));
+        fillCells(block->content.data() + dataIndex, -1, fillCount);
+
+        // Decode once per program when it is shared, otherwise per block.
+        block->decoded.reset();
+        if (simOptions.fuseInstructions)
+        {
+            if (proc.program)
+            {
+                if (!proc.program->decoded)
+                    proc.program->decoded = decodeBlockProgram(block->content);
+                block->decoded = proc.program->decoded;
+            }
+            else if (proc.staged && proc.staged->blockDecoded)
+            {
+                block->decoded = proc.staged->decoded;
+            }
+            else
+            {
+                block->decoded = decodeBlockProgram(block->content);
+            }
+        }
+
+        return true;
+    }
+
+    // -------------------------------------------------------------------------
+    // loadWaitingJobs: Coalesce only if a job fails to fit on first try
+    // -------------------------------------------------------------------------
+    void printAllocatedSegments(const vector<MemBlock *> &segments, int processID)
+    {
+        logBuffer << "Process " << processID << " allocated segments:" << endl;
+        int totalSize = 0; // Accumulate total size
+        for (size_t i = 0; i < segments.size(); i++)
+        {
+            int start = segments[i]->start;
+            int size = segments[i]->size;
+            int end = start + size - 1;
+            bool shared = segments[i]->processID == SHARED_SEGMENT_OWNER;
+            if (!shared)
+                totalSize += size;
+            logBuffer << "  Segment " << i << ": Start = " << start
+                      << ", End = " << end
+                      << ", Size = " << size << (shared ? " (shared code)" : "") << endl;
+        }
+        // Append the total size at the end.
+        logBuffer << "Total size allocated: " << totalSize << endl;
+    }
+
+    // A function to output all accumulated logs at the end.
+    void flushLogs()
+    {
+        ScopedTimer timer(hostTimer(HOST_FLUSH));
+        out << logBuffer.str();
+        // out << freeListLog.str();
+    }
+
+    // A helper function to capture the current free list.
+    void captureFreeList(MemBlock *freeList, string type)
+    {
+
+        freeListLog << type;
+        for (MemBlock *current = freeList; current != nullptr; current = current->next)
+        {
+
+            freeListLog << "[Start:" << current->start << ", Size:" << current->size
+                        << ", End:" << current->start + current->size - 1 << "] -> " << "\n";
+        }
+
+        freeListLog << "\n";
+    }
+
+    // Define error codes for clarity:
+#define ALLOC_ERROR_NONE 0
+#define ALLOC_ERROR_NO_SEGMENT_BLOCK 1
+#define ALLOC_ERROR_INSUFFICIENT_FREE_MEMORY 2
+
+    // Next-fit resumes its search at the address where the last allocation ended.
+    int nextFitCursor = 0;
+
+    // Cells reserved for the segment table: one size cell plus start/size per segment.
+    int segmentTableCells()
+    {
+        return 1 + 2 * simOptions.maxSegments;
+    }
+
+    // A planned piece of an allocation: take 'size' cells from the front of 'block'.
+    struct SegmentPick
+    {
+        MemBlock *block;
+        int size;
+    };
+
+    // Choose the index of the free block to take next, or -1 if none qualifies.
+    // 'avail' holds the cells of each block not yet claimed by the plan,
+    // 'minSize' is the smallest block that may be chosen and 'wanted' the number
+    // of cells still needed.
+    int pickFreeBlock(const vector<MemBlock *> &freeBlocks, const vector<int> &avail,
+                      int minSize, int wanted, PlacementPolicy policy)
+    {
+        int chosen = -1;
+        int n = (int)freeBlocks.size();
+        if (policy == PLACE_FIRST_FIT || policy == PLACE_NEXT_FIT)
+        {
+            // Address order; next-fit starts at the cursor and wraps around.
+            int first = 0;
+            if (policy == PLACE_NEXT_FIT)
+            {
+                while (first < n && freeBlocks[first]->start < nextFitCursor)
+                    first++;
+            }
+            for (int k = 0; k < n; k++)
+            {
+                int i = (first + k) % n;
+                if (avail[i] > 0 && avail[i] >= minSize)
+                    return i;
+            }
+            return -1;
+        }
+
+        // Best-fit takes the tightest block that finishes the request, and the
+        // largest block when none can; worst-fit always takes the largest.
+        int tightest = -1, largest = -1;
+        for (int i = 0; i < n; i++)
+        {
+            if (avail[i] <= 0 || avail[i] < minSize)
+                continue;
+            int size = avail[i];
+            if (size >= wanted && (tightest == -1 || size < avail[tightest]))
+                tightest = i;
+            if (largest == -1 || size > avail[largest])
+                largest = i;
+        }
+        if (policy == PLACE_BEST_FIT)
+            chosen = (tightest != -1) ? tightest : largest;
+        else
+            chosen = largest;
+        return chosen;
+    }
+
+    // Plan which free blocks an allocation of 'requiredTotal' cells uses, without
+    // touching the free list. The first pick holds the segment table and must be
+    // at least 'tableCells' long; with 'exactFirst' it takes exactly that many
+    // cells. At most 'maxPicks' pieces are added. Returns false if the cap is
+    // reached before enough cells are found.
+    bool planSegments(const vector<MemBlock *> &freeBlocks, vector<int> &avail, int requiredTotal,
+                      int tableCells, bool exactFirst, int maxPicks,
+                      PlacementPolicy policy, vector<SegmentPick> &plan)
+    {
+        int allocatedTotal = 0;
+        int picks = 0;
+        while (allocatedTotal < requiredTotal && picks < maxPicks)
+        {
+            int stillNeeded = requiredTotal - allocatedTotal;
+            bool first = picks == 0;
+            int minSize = first ? tableCells : 1;
+            int i = pickFreeBlock(freeBlocks, avail, minSize, first && exactFirst ? tableCells : stillNeeded, policy);
+            if (i == -1)
+                break;
+            int take = min(avail[i], stillNeeded);
+            if (first && exactFirst)
+                take = tableCells;
+            avail[i] -= take;
+            plan.push_back({freeBlocks[i], take});
+            allocatedTotal += take;
+            picks++;
+        }
+        return allocatedTotal >= requiredTotal;
+    }
+
+    // Carve the planned pieces out of the free list, in plan order. Pieces
+    // taken from the same block come off its front one after another.
+    vector<MemBlock *> carveSegments(MemBlock *&segmentedMemory, const vector<SegmentPick> &plan, int owner)
+    {
+        vector<MemBlock *> segments;
+        for (const SegmentPick &pick : plan)
+        {
+            MemBlock *block = pick.block;
+            if (pick.size == block->size)
+            {
+                // Whole block: unlink it from the free list.
+                if (segmentedMemory == block)
+                {
+                    segmentedMemory = block->next;
+                }
+                else
+                {
+                    MemBlock *prev = segmentedMemory;
+                    while (prev->next != block)
+                        prev = prev->next;
+                    prev->next = block->next;
+                }
+                block->next = nullptr;
+                block->processID = owner;
+                segments.push_back(block);
+            }
+            else
+            {
+                // Split: the front of the block is allocated, the rest stays free
+                // in place, so the list remains sorted by start.
+                MemBlock *allocatedBlock = newBlock();
+                allocatedBlock->processID = owner;
+                allocatedBlock->start = block->start;
+                allocatedBlock->size = pick.size;
+                allocatedBlock->content.resize(pick.size, -1);
+                allocatedBlock->next = nullptr;
+                segments.push_back(allocatedBlock);
+
+                block->start += pick.size;
+                block->size -= pick.size;
+            }
+        }
+        return segments;
+    }
+
+    // Shared-code layout: [segment table + PCB][code][data]. The table always
+    // reserves room for the full segment cap so the code starts at a fixed
+    // logical address. The code segment is allocated on the program's first
+    // admission and mapped by every later one. The data area is private from
+    // the start (it holds only -1 until stored to), not copy-on-write. Returns
+    // an empty vector if the layout does not fit; the caller then falls back
+    // to a private image.
+    vector<MemBlock *> allocateSharedSegments(MemBlock *&segmentedMemory, const vector<MemBlock *> &freeBlocks,
+                                              Process &job)
+    {
+        ProgramImage &prog = *job.program;
+        int codeSize = prog.codeSize();
+        int headCells = segmentTableCells() + 10;
+        int dataCells = job.maxMemoryNeeded - codeSize;
+        vector<SegmentPick> plan;
+        if (codeSize == 0 || dataCells < 0 || simOptions.maxSegments < 2)
+            return vector<MemBlock *>();
+
+        vector<int> avail;
+        for (MemBlock *blk : freeBlocks)
+            avail.push_back(blk->size);
+
+        // The code segment must be one contiguous piece.
+        bool needCode = prog.codeSegment == nullptr;
+        if (needCode)
+        {
+            int i = pickFreeBlock(freeBlocks, avail, codeSize, codeSize, simOptions.placement);
+            if (i == -1)
+                return vector<MemBlock *>();
+            avail[i] -= codeSize;
+            plan.push_back({freeBlocks[i], codeSize});
+        }
+        size_t privateFrom = plan.size();
+        if (!planSegments(freeBlocks, avail, headCells + dataCells, headCells, true,
+                          simOptions.maxSegments - 1, simOptions.placement, plan))
+            return vector<MemBlock *>();
+
+        vector<MemBlock *> carved = carveSegments(segmentedMemory, plan, job.processID);
+        if (needCode)
+        {
+            prog.codeSegment = carved[0];
+            prog.codeSegment->processID = SHARED_SEGMENT_OWNER;
+            prog.codeLoaded = false;
+            sharingStats.residentSharedSegments++;
+            sharingStats.peakSharedSegments = max(sharingStats.peakSharedSegments, sharingStats.residentSharedSegments);
+        }
+        else
+        {
+            sharingStats.sharedAdmissions++;
+            sharingStats.cellsSaved += codeSize;
+        }
+        prog.residentUsers++;
+        job.sharesCode = true;
+
+        vector<MemBlock *> segments;
+        segments.push_back(carved[privateFrom]);
+        segments.push_back(prog.codeSegment);
+        for (size_t i = privateFrom + 1; i < carved.size(); i++)
+            segments.push_back(carved[i]);
+        nextFitCursor = carved.back()->start + carved.back()->size;
+        return segments;
+    }
+
+    // Plan an allocation that stays inside one bank, trying the banks with the
+    // most free cells first. Returns false if no single bank can hold it.
+    bool planInOneBank(const vector<MemBlock *> &freeBlocks, const vector<int> &avail, int requiredTotal,
+                       int tableCells, vector<SegmentPick> &plan)
+    {
+        vector<int> freeCells(memoryBanks.size(), 0);
+        for (size_t i = 0; i < freeBlocks.size(); i++)
+            freeCells[bankOf(freeBlocks[i]->start)] += avail[i];
+        vector<int> order;
+        for (int b = 0; b < (int)memoryBanks.size(); b++)
+            order.push_back(b);
+        stable_sort(order.begin(), order.end(), [&](int x, int y)
+                    { return freeCells[x] > freeCells[y]; });
+
+        PlacementPolicy policies[2] = {simOptions.placement, PLACE_WORST_FIT};
+        for (int b : order)
+        {
+            if (freeCells[b] < requiredTotal)
+                break;
+            for (PlacementPolicy policy : policies)
+            {
+                vector<int> bankAvail(avail.size(), 0);
+                for (size_t i = 0; i < freeBlocks.size(); i++)
+                {
+                    if (bankOf(freeBlocks[i]->start) == b)
+                        bankAvail[i] = avail[i];
+                }
+                plan.clear();
+                if (planSegments(freeBlocks, bankAvail, requiredTotal, tableCells, false, simOptions.maxSegments,
+                                 policy, plan))
+                    return true;
+            }
+        }
+        plan.clear();
+        return false;
+    }
+
+    // A swapped image is read back whole, so swap-in passes allowSharing false.
+    vector<MemBlock *> allocateProcessSegments(MemBlock *&segmentedMemory, Process &job, int &errorCode,
+                                               bool allowSharing = true)
+    {
+        ScopedTimer timer(hostTimer(HOST_ALLOCATION));
+        vector<MemBlock *> segments;
+        errorCode = ALLOC_ERROR_NONE; // assume success to start
+
+        // Calculate the total number of cells needed:
+        // 10 for PCB fields, the segment table reservation (13 cells for the
+        // default cap of 6 segments), plus job.maxMemoryNeeded cells for the process data.
+        int tableCells = segmentTableCells();
+        int requiredTotal = 10 + tableCells + job.maxMemoryNeeded;
+
+        captureFreeList(segmentedMemory, "before");
+        coalesceFreeList(segmentedMemory, true);
+
+        // ***** Preliminary Check: Separate Conditions *****
+        int totalFree = 0;
+        bool foundTableBlock = false;
+        vector<MemBlock *> freeBlocks;
+        vector<int> avail;
+        for (MemBlock *iter = segmentedMemory; iter != nullptr; iter = iter->next)
+        {
+            if (iter->processID == -1)
+            {
+                freeBlocks.push_back(iter);
+                avail.push_back(iter->size);
+                totalFree += iter->size;
+                if (iter->size >= tableCells)
+                    foundTableBlock = true;
+            }
+        }
+
+        // Processes running a shared program only need private room for the
+        // table, PCB and data when the code is already resident.
+        job.sharesCode = false;
+        if (simOptions.shareCode && allowSharing && job.program)
+        {
+            segments = allocateSharedSegments(segmentedMemory, freeBlocks, job);
+            if (!segments.empty())
+            {
+                noteBankAllocation(segments, segmentedMemory);
+                return segments;
+            }
+        }
+        // First check: Is there at least one free block big enough for the segment table?
+        if (!foundTableBlock)
+        {
+            errorCode = ALLOC_ERROR_NO_SEGMENT_BLOCK;
+            return segments;
+        }
+        // Second check: Is the total free memory available enough for the required total?
+        if (totalFree < requiredTotal)
+        {
+            errorCode = ALLOC_ERROR_INSUFFICIENT_FREE_MEMORY;
+            return segments;
+        }
+        // ***** End Preliminary Checks *****
+
+        // STEP 1: Plan the placement with the configured policy. Free blocks at any
+        // address may be used. If the policy runs into the segment cap, fall back to
+        // taking the largest blocks first, which needs the fewest segments. With
+        // memory banks, first try to keep the whole process in one bank.
+        vector<SegmentPick> plan;
+        vector<int> planAvail = avail;
+        bool planned = banksEnabled() && simOptions.bankLocal &&
+                       planInOneBank(freeBlocks, avail, requiredTotal, tableCells, plan);
+        if (!planned && !planSegments(freeBlocks, planAvail, requiredTotal, tableCells, false, simOptions.maxSegments,
+                                      simOptions.placement, plan))
+        {
+            plan.clear();
+            planAvail = avail;
+            if (!planSegments(freeBlocks, planAvail, requiredTotal, tableCells, false, simOptions.maxSegments,
+                              PLACE_WORST_FIT, plan))
+            {
+                errorCode = ALLOC_ERROR_INSUFFICIENT_FREE_MEMORY;
+                return segments;
+            }
+        }
+
+        // STEP 2: Carve the planned pieces out of the free list.
+        segments = carveSegments(segmentedMemory, plan, job.processID);
+
+        nextFitCursor = segments.back()->start + segments.back()->size;
+        noteBankAllocation(segments, segmentedMemory);
+        return segments;
+    }
+
+    // Load a process laid out by allocateSharedSegments: segments[0] holds the
+    // padded segment table and the PCB, segments[1] is the shared code segment
+    // (filled only by its first user) and the rest is data.
+    bool loadJobIntoSharedSegments(Process &proc, vector<MemBlock *> &segments)
+    {
+        ProgramImage &prog = *proc.program;
+        int numSegments = (int)segments.size();
+        int segTableSize = 2 * simOptions.maxSegments; // padded, unused entries have size 0
+        int offset = segTableSize + 1;
+
+        for (size_t i = 0; i < segments.size(); i++)
+        {
+            if (i == 1)
+                continue;
+            segments[i]->content.assign(segments[i]->size, -1);
+            segments[i]->dirtyMask.clear();
+            segments[i]->dirtyLo = 0;
+            segments[i]->dirtyHi = -1;
+        }
+
+        vector<int> &head = segments[0]->content;
+        head[0] = segTableSize;
+        for (int i = 0; i < simOptions.maxSegments; i++)
+        {
+            head[1 + 2 * i] = i < numSegments ? segments[i]->start : 0;
+            head[2 + 2 * i] = i < numSegments ? segments[i]->size : 0;
+        }
+        int *pcb = head.data() + offset;
+        pcb[PCBLayout::ID] = proc.processID;
+        pcb[PCBLayout::STATE] = STATE_RUNNING;
+        pcb[PCBLayout::PC] = 0;
+        pcb[PCBLayout::INSTRUCTION_BASE] = PCBLayout::SIZE + offset;
+        pcb[PCBLayout::DATA_BASE] = PCBLayout::SIZE + offset + (int)prog.instrList.size();
+        pcb[PCBLayout::MEMORY_LIMIT] = proc.maxMemoryNeeded;
+        pcb[PCBLayout::CPU_CYCLES] = 0;
+        pcb[PCBLayout::REGISTER] = 0;
+        pcb[PCBLayout::MAX_MEMORY] = proc.maxMemoryNeeded;
+        pcb[PCBLayout::MAIN_MEMORY_BASE] = segments[0]->start;
+
+        // First user of the code segment fills it.
+        MemBlock *code = segments[1];
+        if (!prog.codeLoaded)
+        {
+            prog.codeLoaded = true;
+            code->content.resize(code->size);
+            copyCells(code->content.data(), prog.instrList.data(), prog.instrList.size());
+            copyCells(code->content.data() + prog.instrList.size(), prog.operandList.data(), prog.operandList.size());
+            copyCells(&physicalMemory[code->start], code->content.data(), code->size);
+        }
+
+        for (size_t i = 0; i < segments.size(); i++)
+        {
+            if (i != 1)
+                copyCells(&physicalMemory[segments[i]->start], segments[i]->content.data(), segments[i]->size);
+        }
+        return true;
+    }
+
+    // Return a process's segments to the free list. A shared code segment is
+    // only freed when its last user goes.
+    void releaseProcessSegments(Process &proc, MemBlock *&segmentedMemory)
+    {
+        for (MemBlock *seg : proc.segmentedBlocks)
+        {
+            if (seg->processID != SHARED_SEGMENT_OWNER)
+                freeMemoryBlock(seg, segmentedMemory);
+        }
+        if (proc.sharesCode)
+        {
+            ProgramImage &prog = *proc.program;
+            if (--prog.residentUsers == 0 && prog.codeSegment)
+            {
+                freeMemoryBlock(prog.codeSegment, segmentedMemory);
+                prog.codeSegment = nullptr;
+                sharingStats.residentSharedSegments--;
+            }
+            proc.sharesCode = false;
+        }
+        proc.segmentedBlocks.clear();
+        sampleBankUsage(segmentedMemory);
+    }
+
+    // A store may land in the code area (logical addresses are relative to the
+    // instruction base). When the running copy of the code no longer matches the
+    // shared segment, give the process its own copy and point its segment table
+    // at it.
+    void resolveCopyOnWrite(Process &proc, MemBlock *block, MemBlock *&segmentedMemory)
+    {
+        if (!proc.sharesCode || proc.segmentedBlocks.size() < 2)
+            return;
+        ProgramImage &prog = *proc.program;
+        MemBlock *shared = proc.segmentedBlocks[1];
+        int codeSize = prog.codeSize();
+        const int *running = block->content.data() + 10;
+        if (compareCells(running, shared->content.data(), codeSize) == (size_t)codeSize)
+            return;
+
+        coalesceFreeList(segmentedMemory, true);
+        vector<MemBlock *> freeBlocks;
+        vector<int> avail;
+        for (MemBlock *iter = segmentedMemory; iter != nullptr; iter = iter->next)
+        {
+            freeBlocks.push_back(iter);
+            avail.push_back(iter->size);
+        }
+        int i = pickFreeBlock(freeBlocks, avail, codeSize, codeSize, simOptions.placement);
+        if (i == -1)
+        {
+            // Try again after the next time slice; the running copy is unaffected.
+            out << "Copy-on-write for Process " << proc.processID << " deferred: no free block of "
+                 << codeSize << " cells." << endl;
+            return;
+        }
+        vector<SegmentPick> plan(1, SegmentPick{freeBlocks[i], codeSize});
+        MemBlock *copy = carveSegments(segmentedMemory, plan, proc.processID)[0];
+        copy->content.resize(codeSize);
+        copy->dirtyMask.clear();
+        copy->dirtyLo = 0;
+        copy->dirtyHi = -1;
+        copyCells(copy->content.data(), running, codeSize);
+        copyCells(&physicalMemory[copy->start], copy->content.data(), codeSize);
+        proc.segmentedBlocks[1] = copy;
+        writeSegmentCell(proc.segmentedBlocks, 3, copy->start); // segment 1 start in the table
+
+        if (--prog.residentUsers == 0)
+        {
+            freeMemoryBlock(prog.codeSegment, segmentedMemory);
+            prog.codeSegment = nullptr;
+            sharingStats.residentSharedSegments--;
+        }
+        proc.sharesCode = false;
+        sharingStats.copyOnWrites++;
+    }
+
+    void printSharingReport()
+    {
+        out << "----- Code Sharing Report -----" << endl;
+        out << "Distinct programs: ";
+        size_t programs = 0;
+        for (const auto &bucket : programCache)
+            programs += bucket.second.size();
+        out << programs << endl;
+        out << "Admissions mapping a resident code segment: " << sharingStats.sharedAdmissions << endl;
+        out << "Code cells not allocated thanks to sharing: " << sharingStats.cellsSaved << endl;
+        out << "Copy-on-write copies: " << sharingStats.copyOnWrites << endl;
+        out << "Peak resident shared code segments: " << sharingStats.peakSharedSegments << endl;
+        out << "-------------------------------" << endl;
+    }
+
+    bool loadJobIntoSegments(Process &proc, vector<MemBlock *> &segments)
+    {
+        if (proc.sharesCode)
+            return loadJobIntoSharedSegments(proc, segments);
+
+        // Step 0: Ensure each segment's content array is resized properly.
+        for (size_t i = 0; i < segments.size(); i++)
+        {
+            segments[i]->content.resize(segments[i]->size, -1);
+            // The whole image is written to physicalMemory below, so start clean.
+            segments[i]->dirtyMask.clear();
+            segments[i]->dirtyLo = 0;
+            segments[i]->dirtyHi = -1;
+        }
+
+        // Step 1: Separate the instructions and operands from the process,
+        // unless pre-staging already did.
+        vector<int> splitInstr;
+        vector<int> splitOperands;
+        if (!proc.staged)
+            splitInstructions(processInstructions(proc), splitInstr, splitOperands);
+        const vector<int> &instrList = proc.staged ? proc.staged->instrList : splitInstr;
+        const vector<int> &operandList = proc.staged ? proc.staged->operandList : splitOperands;
+
+        int instructionCount = (int)instrList.size();
+        int operandCount = (int)operandList.size();
+
+        // Step 2: Build a contiguous logical image similar to loadJobIntoBlock.
+        // In the old code, the first 10 cells were for the PCB, so let’s assume:
+        //   - We reserve a segment table at the beginning.
+        // Let the segment table size be 2*number_of_segments (each segment: start and size)
+        int numSegments = segments.size();
+        int segTableSize = numSegments * 2; // two entries per segment
+        int PCBFields = 10;                 // fixed 10 PCB fields
+        int totalLogicalSize = segTableSize + 1 + PCBFields + instructionCount + operandCount;
+
+        // Create a temporary contiguous array for the process image.
+        vector<int> logicalMemory(totalLogicalSize, -1);
+
+        // Write the segment table at the beginning:
+        // At index 0, we store segTableSize. Then store each segment's physical start and size.
+        logicalMemory[0] = segTableSize;
+        for (int i = 0; i < numSegments; i++)
+        {
+            logicalMemory[1 + 2 * i] = segments[i]->start;
+            logicalMemory[2 + 2 * i] = segments[i]->size;
+        }
+
+        // Write the PCB fields.
+        // PCB fields start at index = segTableSize + 1.
+        int offset = segTableSize + 1;
+        int *pcb = logicalMemory.data() + offset;
+        pcb[PCBLayout::ID] = proc.processID;
+        pcb[PCBLayout::STATE] = STATE_RUNNING;
+        pcb[PCBLayout::PC] = 0;
+        // The following two fields are normally set to 10 in the old code, so we adjust them.
+        pcb[PCBLayout::INSTRUCTION_BASE] = PCBLayout::SIZE + offset;
+        pcb[PCBLayout::DATA_BASE] = PCBLayout::SIZE + offset + instructionCount; // after instructions
+        pcb[PCBLayout::MEMORY_LIMIT] = proc.maxMemoryNeeded;
+        pcb[PCBLayout::CPU_CYCLES] = 0;
+        pcb[PCBLayout::REGISTER] = 0;
+        pcb[PCBLayout::MAX_MEMORY] = proc.maxMemoryNeeded; // duplicate memory limit
+        // Main Memory Base: we use the start of the first segment.
+        pcb[PCBLayout::MAIN_MEMORY_BASE] = segments[0]->start;
+
+        // Write the instructions and operands immediately following the PCB fields.
+        int dataStart = offset + PCBFields;
+        copyCells(logicalMemory.data() + dataStart, instrList.data(), instructionCount);
+        copyCells(logicalMemory.data() + dataStart + instructionCount, operandList.data(), operandCount);
+
+        // Step 3: Distribute the contiguous logicalMemory into the allocated segments,
+        // one run per segment.
+        int logicalIndex = 0;
+        for (size_t seg = 0; seg < segments.size() && logicalIndex < totalLogicalSize; seg++)
+        {
+            int run = min(segments[seg]->size, totalLogicalSize - logicalIndex);
+            copyCells(segments[seg]->content.data(), logicalMemory.data() + logicalIndex, run);
+            logicalIndex += run;
+        }
+
+        // Step 4: Update PhysicalMemory for every segment.
+        for (size_t seg = 0; seg < segments.size(); seg++)
+        {
+            copyCells(&physicalMemory[segments[seg]->start], segments[seg]->content.data(), segments[seg]->size);
+        }
+
+        return (logicalIndex == totalLogicalSize);
+    }
+
+    // Helper function to print details about allocated segmented blocks.
+
+    // Debugging function to print allocated blocks for a process.
+    void printAllocatedBlocksForProcess(int processID, const vector<MemBlock *> &segments)
+    {
+        out << "Process " << processID << " allocated blocks:" << endl;
+        for (size_t i = 0; i < segments.size(); i++)
+        {
+            MemBlock *block = segments[i];
+            out << "  Block " << i
+                 << " -> Start: " << block->start
+                 << ", Size: " << block->size << endl;
+        }
+    }
+
+    // -------------------------------------------------------------------------
+    // Parallel Image Loading
+    // -------------------------------------------------------------------------
+    // loadWaitingJobs makes every allocation decision and prints every message on
+    // the scheduler thread, in queue order. Building the admitted images (filling
+    // segments, mirroring them into physicalMemory, decoding the block) only
+    // touches memory the job was just given, so it is deferred to the end of the
+    // round and spread over the loader pool.
+
+    class WorkerPool
+    {
+    public:
+        WorkerPool() : stopping(false), generation(0), current(nullptr), taskCount(0), remaining(0), active(0) {}
+        ~WorkerPool() { stop(); }
+
+        void start(int threads)
+        {
+            for (int i = 0; i < threads; i++)
+                workers.push_back(thread(&WorkerPool::workerLoop, this));
+        }
+
+        void stop()
+        {
+            {
+                lock_guard<mutex> lock(mtx);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (thread &worker : workers)
+                worker.join();
+            workers.clear();
+            stopping = false;
+        }
+
+        // Run task(0) .. task(count - 1) on the workers and the calling thread.
+        // Returns once every task has finished.
+        void parallelFor(int count, const function<void(int)> &task)
+        {
+            if (workers.empty() || count < 2)
+            {
+                for (int i = 0; i < count; i++)
+                    task(i);
+                return;
+            }
+            {
+                lock_guard<mutex> lock(mtx);
+                current = &task;
+                taskCount = count;
+                nextIndex.store(0);
+                remaining = count;
+                generation++;
+            }
+            wake.notify_all();
+            int done = runTasks(task, count);
+            unique_lock<mutex> lock(mtx);
+            remaining -= done;
+            // Also wait for workers still inside this round, so none of them can
+            // pick up an index of the next one.
+            finished.wait(lock, [this] { return remaining == 0 && active == 0; });
+            current = nullptr;
+        }
+
+    private:
+        int runTasks(const function<void(int)> &task, int count)
+        {
+            int done = 0;
+            int i;
+            while ((i = nextIndex.fetch_add(1)) < count)
+            {
+                task(i);
+                done++;
+            }
+            return done;
+        }
+
+        void workerLoop()
+        {
+            long long seen = 0;
+            unique_lock<mutex> lock(mtx);
+            while (true)
+            {
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+                if (current == nullptr)
+                    continue;
+                const function<void(int)> *task = current;
+                int count = taskCount;
+                active++;
+                lock.unlock();
+                int done = runTasks(*task, count);
+                lock.lock();
+                active--;
+                remaining -= done;
+                finished.notify_all();
+            }
+        }
+
+        vector<thread> workers;
+        mutex mtx;
+        condition_variable wake;
+        condition_variable finished;
+        bool stopping;
+        long long generation;
+        const function<void(int)> *current;
+        int taskCount;
+        atomic<int> nextIndex;
+        int remaining;
+        int active;
+    };
+
+    WorkerPool loaderPool;
+
+    // An admitted job whose image has not been built yet. Either part may
+    // already have been loaded on the scheduler thread (empty / nullptr).
+    struct PendingLoad
+    {
+        int processIndex;
+        vector<MemBlock *> segments;
+        MemBlock *block;
+    };
+
+    // Whether loadJobIntoSegments / loadJobIntoBlock will succeed. Every
+    // instruction word becomes one cell of the image, opcode or operand.
+    bool segmentImageFits(const Process &job, const vector<MemBlock *> &segments)
+    {
+        long long capacity = 0;
+        for (MemBlock *seg : segments)
+            capacity += seg->size;
+        long long image = 2 * (long long)segments.size() + 1 + PCBLayout::SIZE + processInstructions(job).size();
+        return capacity >= image;
+    }
+
+    bool blockImageFits(const Process &job)
+    {
+        return job.maxMemoryNeeded >= (int)processInstructions(job).size();
+    }
+
+    void buildPendingImages(vector<Process> &processes, const vector<PendingLoad> &pending)
+    {
+        loaderPool.parallelFor((int)pending.size(), [&](int i)
+                               {
+            const PendingLoad &load = pending[i];
+            Process &job = processes[load.processIndex];
+            if (!load.segments.empty())
+            {
+                vector<MemBlock *> segments = load.segments;
+                loadJobIntoSegments(job, segments);
+            }
+            if (load.block)
+                loadJobIntoBlock(job, load.block);
+            job.staged.reset(); });
+    }
+
+    void loadWaitingJobs(deque<int> &newJobQueue,
+                         vector<Process> &processes,
+                         MemBlock *&logicalList,        // contiguous (logical) free list for execution
+                         MemBlock *&segmentedMemory,    // free list for segmented allocation
+                         queue<MemBlock *> &readyQueue, // readyQueue for execution (contains contiguous block)
+                         int now)
+    {
+        ScopedTimer timer(hostTimer(HOST_ADMISSION));
+        // Take a batch of jobs submitted through the job submission API.
+        if (jobSubmission.hasWork())
+            drainSubmittedJobs(newJobQueue, now, simOptions.submitBatch);
+        compactJobArena();
+
+        // Swapped processes that are ready to come back take precedence: no new
+        // job is loaded while one of them is still waiting for memory.
+        if (simOptions.swapping && !ioQueue.swapInQueue.empty())
+        {
+            swapInReadyProcesses(ioQueue, readyQueue, processes, segmentedMemory, totalCpuCycles);
+            if (!ioQueue.swapInQueue.empty())
+                return;
+        }
+        vector<PendingLoad> pending;
+
+        // Process jobs one at a time from the newJobQueue.
+        while (!newJobQueue.empty())
+        {
+            int idx = newJobQueue.front(); // Look at the first process (do not pop yet)
+            if (jobs[idx].processIndex < 0)
+                buildQueuedJob(idx);
+            int processIndex = jobs[idx].processIndex;
+            Process &job = processes[processIndex];
+
+            // out << "Process " << job.processID
+            //      << " - Free segments BEFORE allocation:" << endl;
+            // printFreeList(segmentedMemory, "Free segments before load", "watever");
+
+            // Attempt to allocate segmented memory for this process.
+
+            int allocError = ALLOC_ERROR_NONE;
+            vector<MemBlock *> segments = allocateProcessSegments(segmentedMemory, job, allocError);
+
+            // If segmented memory allocation fails...
+            if (segments.empty())
+            {
+
+                if (allocError == ALLOC_ERROR_NO_SEGMENT_BLOCK)
+                {
+                    out << "Process " << job.processID
+                         << " could not be loaded due to insufficient contiguous space for segment table." << endl;
+                    break; // or continue to the next job based on your scheduling policy.
+                }
+                else if (allocError == ALLOC_ERROR_INSUFFICIENT_FREE_MEMORY)
+                {
+                    // Print the free list before coalescing.
+                    out << "Insufficient memory for Process " << job.processID
+                         << ". Attempting memory coalescing." << endl;
+
+                    coalesceFreeList(segmentedMemory, true);
+
+                    // Try allocation again.
+                    segments = allocateProcessSegments(segmentedMemory, job, allocError);
+                }
+
+                if (segments.empty())
+                {
+                    out << "Process " << job.processID
+                         << " waiting in NewJobQueue due to insufficient memory." << endl;
+                    // Since the process at the head cannot be loaded even after coalescing,
+                    // break out of the loop to stop checking further processes.
+                    break;
+                }
+            }
+
+            // If segmented allocation succeeded, load the process image into these
+            // segments. A load that will fit is left for buildPendingImages; one
+            // that will not, or that maps shared code, runs now.
+            bool deferSegments = !job.sharesCode && segmentImageFits(job, segments);
+            if (deferSegments || loadJobIntoSegments(job, segments))
+            {
+
+                out << "Process " << job.processID
+                     << " loaded with segment table stored at physical address "
+                     << segments[0]->start << endl;
+                noteEvent(EVENT_LOADED, job.processID, totalCpuCycles);
+
+                // Save the allocated segmented blocks into the Process object for later freeing.
+
+                job.segmentedBlocks = segments;
+
+                printAllocatedSegments(segments, job.processID);
+            }
+            else
+            {
+                out << "Process " << job.processID
+                     << " failed to load into segmented memory." << endl;
+                // Remove this process from the newJobQueue and continue.
+                newJobQueue.pop_front();
+                continue;
+            }
+
+            PendingLoad load = {processIndex, deferSegments ? segments : vector<MemBlock *>(), nullptr};
+
+            // Allocate a contiguous block from the logical free list for execution.
+            // An interned program is decoded into its shared ProgramImage by the
+            // first load, so those blocks are loaded here as well.
+            MemBlock *contiguousBlock = allocateMemoryForJob(logicalList, job);
+            bool deferBlock = contiguousBlock != nullptr && !job.program && blockImageFits(job);
+            if (contiguousBlock == nullptr || (!deferBlock && !loadJobIntoBlock(job, contiguousBlock)))
+            {
+                out << "Contiguous allocation or load failed for Process " << job.processID << endl;
+                pending.push_back(load);
+                // Stop processing further if contiguous allocation fails.
+                break;
+            }
+            if (deferBlock)
+                load.block = contiguousBlock;
+            pending.push_back(load);
+
+            // If both segmented and contiguous allocations succeeded, push the process to readyQueue.
+            readyQueue.push(contiguousBlock);
+
+            // Finally, remove the process from the newJobQueue (it is now loaded).
+            newJobQueue.pop_front();
+        }
+
+        buildPendingImages(processes, pending);
+        prestageUpcomingJobs(newJobQueue);
+    }
+
+    // -------------------------------------------------------------------------
+    // Job Pre-staging
+    // -------------------------------------------------------------------------
+    // With --prestage[=K] a helper thread prepares the first K jobs of the
+    // NewJobQueue while the scheduler runs: it decodes their instructions,
+    // splits them into opcodes and operands and decodes the program for the
+    // fused engine. When a job reaches the head of the queue loadWaitingJobs
+    // collects the StagedJob, so admission is down to allocating and copying.
+    // The stager works on a copy of the job's encoded bytes and never touches
+    // jobArena, jobs, processes or the queues. A job whose staging has not
+    // started when it reaches the head is prepared on the scheduler thread as
+    // before; one that is being staged is waited for.
+
+    struct StageRequest
+    {
+        int jobIndex;
+        int maxMemoryNeeded;
+        string encoded; // the job's bytes in jobArena
+        int cells;
+    };
+
+    class JobStager
+    {
+    public:
+        explicit JobStager(Impl &owner) : sim(owner), stopping(false), busyIndex(-1) {}
+        ~JobStager() { stop(); }
+
+        void start()
+        {
+            worker = thread(&JobStager::workerLoop, this);
+        }
+
+        void stop()
+        {
+            {
+                lock_guard<mutex> lock(mtx);
+                stopping = true;
+            }
+            wake.notify_all();
+            if (worker.joinable())
+                worker.join();
+            waiting.clear();
+            ready.clear();
+            stopping = false;
+        }
+
+        void post(StageRequest &&request)
+        {
+            {
+                lock_guard<mutex> lock(mtx);
+                waiting.push_back(std::move(request));
+            }
+            wake.notify_one();
+        }
+
+        // The staged job for jobIndex. Returns null (and drops the
+        // request) if the stager has not started on it; waits if it is busy
+        // with it. 'waited' tells which.
+        shared_ptr<StagedJob> take(int jobIndex, bool &waited)
+        {
+            unique_lock<mutex> lock(mtx);
+            waited = busyIndex == jobIndex;
+            staged.wait(lock, [&] { return busyIndex != jobIndex; });
+            auto found = ready.find(jobIndex);
+            if (found != ready.end())
+            {
+                shared_ptr<StagedJob> job = found->second;
+                ready.erase(found);
+                return job;
+            }
+            for (auto it = waiting.begin(); it != waiting.end(); ++it)
+            {
+                if (it->jobIndex == jobIndex)
+                {
+                    waiting.erase(it);
+                    break;
+                }
+            }
+            return nullptr;
+        }
+
+    private:
+        void workerLoop()
+        {
+            unique_lock<mutex> lock(mtx);
+            while (true)
+            {
+                wake.wait(lock, [this] { return stopping || !waiting.empty(); });
+                if (stopping)
+                    return;
+                StageRequest request = std::move(waiting.front());
+                waiting.pop_front();
+                busyIndex = request.jobIndex;
+                lock.unlock();
+                shared_ptr<StagedJob> job = sim.stageJob(request);
+                lock.lock();
+                ready[request.jobIndex] = job;
+                busyIndex = -1;
+                staged.notify_all();
+            }
+        }
+
+        Impl &sim;
+        thread worker;
+        mutex mtx;
+        condition_variable wake;
+        condition_variable staged;
+        bool stopping;
+        deque<StageRequest> waiting;
+        int busyIndex;
+        unordered_map<int, shared_ptr<StagedJob>> ready;
+    };
+
+    JobStager jobStager{*this};
+
+    struct PrestageStats
+    {
+        long long requested = 0;
+        long long collected = 0; // staging was done when the job reached the head
+        long long waited = 0;    // the scheduler waited for the stager
+        long long missed = 0;    // prepared on the scheduler thread instead
+    };
+
+    PrestageStats prestageStats;
+
+    // Runs on the stager thread; only reads the request and the options.
+    shared_ptr<StagedJob> stageJob(StageRequest &request)
+    {
+        shared_ptr<StagedJob> job = make_shared<StagedJob>();
+        decodeJobCells(request.encoded.data(), (int)request.encoded.size(), request.cells, job->instructions);
+        splitInstructions(job->instructions, job->instrList, job->operandList);
+
+        // The block image loadJobIntoBlock lays out; decoding reads only the
+        // code bases, the code and the operands.
+        int codeCells = (int)(job->instrList.size() + job->operandList.size());
+        if (simOptions.fuseInstructions && request.maxMemoryNeeded >= codeCells)
+        {
+            vector<int> image(PCBLayout::SIZE + request.maxMemoryNeeded, -1);
+            image[PCBLayout::INSTRUCTION_BASE] = PCBLayout::SIZE;
+            image[PCBLayout::DATA_BASE] = PCBLayout::SIZE + (int)job->instrList.size();
+            copyCells(image.data() + PCBLayout::SIZE, job->instrList.data(), (int)job->instrList.size());
+            copyCells(image.data() + PCBLayout::SIZE + job->instrList.size(), job->operandList.data(),
+                      (int)job->operandList.size());
+            job->decoded = decodeBlockProgram(image);
+            job->blockDecoded = true;
+        }
+        return job;
+    }
+
+    // Hand the first prestageDepth jobs of the NewJobQueue that are not yet
+    // requested to the stager. Interned programs are already split.
+    void prestageUpcomingJobs(const deque<int> &newJobQueue)
+    {
+        if (simOptions.prestageDepth <= 0)
+            return;
+        int depth = min((int)newJobQueue.size(), simOptions.prestageDepth);
+        for (int i = 0; i < depth; i++)
+        {
+            int idx = newJobQueue[i];
+            QueuedJob &job = jobs[idx];
+            if (job.prestage != PRESTAGE_NONE || job.encodedOffset < 0)
+                continue;
+            job.prestage = PRESTAGE_REQUESTED;
+            StageRequest request;
+            request.jobIndex = idx;
+            request.maxMemoryNeeded = job.maxMemoryNeeded;
+            request.encoded.assign(jobArena, (size_t)job.encodedOffset, (size_t)job.encodedBytes);
+            request.cells = job.cells;
+            jobStager.post(std::move(request));
+            prestageStats.requested++;
+        }
+    }
+
+    // Called when the Process for the job at the head of the NewJobQueue is
+    // built; gives proc the staged instructions, if any.
+    void collectStagedJob(QueuedJob &job, int idx, Process &proc)
+    {
+        if (job.prestage != PRESTAGE_REQUESTED)
+            return;
+        bool waited = false;
+        shared_ptr<StagedJob> staged = jobStager.take(idx, waited);
+        job.prestage = PRESTAGE_COLLECTED;
+        if (!staged)
+        {
+            prestageStats.missed++;
+            return;
+        }
+        prestageStats.collected++;
+        if (waited)
+            prestageStats.waited++;
+        proc.instructions.swap(staged->instructions);
+        proc.staged = staged;
+    }
+
+    void printPrestageReport()
+    {
+        out << "----- Prestage Report -----" << endl;
+        out << "Look-ahead depth: " << simOptions.prestageDepth << endl;
+        out << "Jobs handed to the stager: " << prestageStats.requested << endl;
+        out << "Collected staged at admission: " << prestageStats.collected << " (waited for " << prestageStats.waited
+             << ")" << endl;
+        out << "Prepared on the scheduler thread instead: " << prestageStats.missed << endl;
+        out << "---------------------------" << endl;
+    }
+
+    // -------------------------------------------------------------------------
+    // Memory Access Profiling
+    // -------------------------------------------------------------------------
+    // With --profile-memory every store and load records its logical address
+    // per process: a histogram over the reservation, the set of distinct cells
+    // touched, and the working set (distinct cells among the last
+    // profileWindow accesses). The report compares each reservation with what
+    // the process used; a reservation only has to reach the image and the
+    // highest address touched.
+
+    static const int PROFILE_BUCKETS = 8;
+
+    struct MemoryProfile
+    {
+        int requested = 0;
+        long long stores = 0;
+        long long loads = 0;
+        int distinctCells = 0;
+        int highestAddress = -1;
+        long long histogram[PROFILE_BUCKETS] = {};
+        int peakWorkingSet = 0;
+        long long workingSetSum = 0; // summed over accesses, for the mean
+        // Released when the process terminates.
+        vector<bool> touched;
+        vector<int> windowCounts; // accesses per cell inside the window
+        vector<int> window;       // ring of the last profileWindow addresses
+        int windowNext = 0;
+        int workingSet = 0;
+    };
+
+    unordered_map<int, MemoryProfile> memoryProfiles;
+
+    void noteMemoryAccess(int processID, int logicalAddr, int memoryLimit, bool store)
+    {
+        if (logicalAddr < 0 || logicalAddr >= memoryLimit)
+            return;
+        MemoryProfile &profile = memoryProfiles[processID];
+        if (profile.touched.empty())
+        {
+            profile.requested = memoryLimit;
+            profile.touched.assign(memoryLimit, false);
+            profile.windowCounts.assign(memoryLimit, 0);
+            profile.window.reserve(simOptions.profileWindow);
+        }
+        (store ? profile.stores : profile.loads)++;
+        profile.histogram[(long long)logicalAddr * PROFILE_BUCKETS / memoryLimit]++;
+        profile.highestAddress = max(profile.highestAddress, logicalAddr);
+        if (!profile.touched[logicalAddr])
+        {
+            profile.touched[logicalAddr] = true;
+            profile.distinctCells++;
+        }
+
+        if ((int)profile.window.size() < simOptions.profileWindow)
+        {
+            profile.window.push_back(logicalAddr);
+        }
+        else
+        {
+            int &oldest = profile.window[profile.windowNext];
+            if (--profile.windowCounts[oldest] == 0)
+                profile.workingSet--;
+            oldest = logicalAddr;
+            profile.windowNext = (profile.windowNext + 1) % simOptions.profileWindow;
+        }
+        if (profile.windowCounts[logicalAddr]++ == 0)
+            profile.workingSet++;
+        profile.peakWorkingSet = max(profile.peakWorkingSet, profile.workingSet);
+        profile.workingSetSum += profile.workingSet;
+    }
+
+    void finishMemoryProfile(int processID)
+    {
+        auto it = memoryProfiles.find(processID);
+        if (it == memoryProfiles.end())
+            return;
+        vector<bool>().swap(it->second.touched);
+        vector<int>().swap(it->second.windowCounts);
+        vector<int>().swap(it->second.window);
+    }
+
+    void printMemoryProfileReport(const vector<QueuedJob> &jobs)
+    {
+        out << "----- Memory Profile Report -----" << endl;
+        long long requested = 0, suggested = 0, touched = 0;
+        for (const QueuedJob &job : jobs)
+        {
+            MemoryProfile empty;
+            auto it = memoryProfiles.find(job.processID);
+            const MemoryProfile &profile = it == memoryProfiles.end() ? empty : it->second;
+            int image = job.cells;
+            int needed = max(image, profile.highestAddress + 1);
+            long long accesses = profile.stores + profile.loads;
+            requested += job.maxMemoryNeeded;
+            suggested += needed;
+            touched += profile.distinctCells;
+            out << "Process " << job.processID << ": requested " << job.maxMemoryNeeded
+                 << ", image " << image
+                 << ", touched " << profile.distinctCells
+                 << " (" << (job.maxMemoryNeeded ? 100.0 * profile.distinctCells / job.maxMemoryNeeded : 0.0) << "%)"
+                 << ", highest address " << profile.highestAddress
+                 << ", suggested " << needed
+                 << ", stores " << profile.stores << ", loads " << profile.loads
+                 << ", working set peak " << profile.peakWorkingSet
+                 << " mean " << (accesses ? (double)profile.workingSetSum / accesses : 0.0)
+                 << ", histogram";
+            for (int b = 0; b < PROFILE_BUCKETS; b++)
+                out << " " << profile.histogram[b];
+            out << endl;
+        }
+        out << "Working set window: " << simOptions.profileWindow << " accesses" << endl;
+        out << "Requested cells: " << requested << endl;
+        out << "Touched cells: " << touched << " (" << (requested ? 100.0 * touched / requested : 0.0) << "%)" << endl;
+        out << "Suggested cells: " << suggested << " (" << (requested ? 100.0 * suggested / requested : 0.0) << "%)" << endl;
+        out << "---------------------------------" << endl;
+    }
+
+    // -------------------------------------------------------------------------
+    // Execution
+    // -------------------------------------------------------------------------
+    template <class Ops>
+    int computeOperandPointerFromBlock(const vector<int> &mem,
+                                       int instructionBase,
+                                       int dataBase,
+                                       int programCounter)
+    {
+        int operandCount = 0;
+        for (int i = 0; i < programCounter; i++)
+        {
+            operandCount += Ops::arity(mem[instructionBase + i]);
+        }
+        return dataBase + operandCount;
+    }
+
+    // Translates a logical address to a physical address using the segment table
+    // stored in the first allocated block from the process's segmented blocks vector.
+    //
+    // Parameters:
+    //   logicalAddress - the address generated by the CPU (logical address)
+    //   segBlocks      - the vector of allocated segments for the process; the
+    //                    first element contains the segment table.
+    // Returns the corresponding physical address or -1 if the address is invalid.
+    int translateLogicalToPhysical(int logicalAddress, const vector<MemBlock *> &segBlocks)
+    {
+        if (segBlocks.empty() || segBlocks[0]->content.empty())
+        {
+            out << "Error: No segment table found." << endl;
+            return -1;
+        }
+
+        // The segment table is stored in the first block.
+        int segTableSize = segBlocks[0]->content[0];
+        int numSegments = segTableSize / 2;
+        int remaining = logicalAddress;
+
+        for (int i = 0; i < numSegments; i++)
+        {
+            // The table is stored in segBlocks[0]->content:
+            //   [1+2*i] is the physical start for segment i.
+            //   [2+2*i] is the size (length) of segment i.
+            int segmentStart = segBlocks[0]->content[1 + 2 * i];
+            int segmentSize = segBlocks[0]->content[1 + 2 * i + 1];
+
+            if (remaining < segmentSize)
+            {
+                // The logical address falls in this segment.
+                int physicalAddress = segmentStart + remaining;
+                return physicalAddress;
+            }
+            else
+            {
+                remaining -= segmentSize;
+            }
+        }
+
+        out << "Memory violation: logical address " << logicalAddress << " out of bounds." << endl;
+        return -1; // return error code if address is invalid
+    }
+
+    // Mirror the PCB fields executeProcess changes into the segmented image.
+    // The contiguous block keeps the PCB at 0; the image keeps it after the
+    // segment table.
+    void syncPCBToSegments(const vector<int> &mem, const vector<MemBlock *> &segBlocks)
+    {
+        if (segBlocks.empty() || segBlocks[0]->content.empty())
+            return;
+        int offset = segBlocks[0]->content[0] + 1;
+        const PCBLayout::Field mirrored[] = {PCBLayout::STATE, PCBLayout::PC, PCBLayout::CPU_CYCLES, PCBLayout::REGISTER};
+        for (PCBLayout::Field field : mirrored)
+            writeSegmentCell(segBlocks, offset + field, mem[field]);
+    }
+
+    // Memory timing policies for the execution core. executeProcess picks one
+    // per call, so the per-access cost model is fixed at compile time inside
+    // the loop: FlatTiming is the original one cycle per access, ModelledTiming
+    // goes through the bank and cache models.
+    struct FlatTiming
+    {
+        static int access(Impl &, int, int, int)
+        {
+            return 1;
+        }
+
+        // Cycles for 'count' consecutive logical cells from logicalAddr.
+        static long long accessRun(Impl &, int, int count, const vector<MemBlock *> &, int)
+        {
+            return count;
+        }
+    };
+
+    struct ModelledTiming
+    {
+        static int access(Impl &sim, int address, int segmentTableStart, int processID)
+        {
+            return sim.chargeMemoryAccess(address, sim.bankOf(segmentTableStart), processID);
+        }
+
+        static long long accessRun(Impl &sim, int logicalAddr, int count, const vector<MemBlock *> &segBlocks,
+                                   int processID)
+        {
+            if (segBlocks.empty())
+                return count;
+            long long cycles = 0;
+            for (int i = 0; i < count; i++)
+                cycles += access(sim, sim.translateLogicalToPhysical(logicalAddr + i, segBlocks), segBlocks[0]->start,
+                                 processID);
+            return cycles;
+        }
+    };
+
+    // Sampling (see Sampled Simulation): a measured slice times accesses with
+    // Base and records what they cost; a fast-forwarded slice only keeps the
+    // caches warm and charges the mean cost measured so far.
+    template <class Base>
+    struct MeasuredTiming
+    {
+        static int access(Impl &sim, int address, int segmentTableStart, int processID)
+        {
+            int cycles = Base::access(sim, address, segmentTableStart, processID);
+            sim.sampling.sliceAccesses++;
+            sim.sampling.sliceAccessCycles += cycles;
+            return cycles;
+        }
+
+        static long long accessRun(Impl &sim, int logicalAddr, int count, const vector<MemBlock *> &segBlocks,
+                                   int processID)
+        {
+            long long cycles = Base::accessRun(sim, logicalAddr, count, segBlocks, processID);
+            sim.sampling.sliceAccesses += count;
+            sim.sampling.sliceAccessCycles += cycles;
+            return cycles;
+        }
+    };
+
+    struct ForwardTiming
+    {
+        static int access(Impl &sim, int address, int, int)
+        {
+            sim.warmCaches(address);
+            return (int)sim.chargeForwardAccesses(1);
+        }
+
+        static long long accessRun(Impl &sim, int logicalAddr, int count, const vector<MemBlock *> &segBlocks, int)
+        {
+            if (sim.cachesEnabled() && !segBlocks.empty())
+            {
+                for (int i = 0; i < count; i++)
+                    sim.warmCaches(sim.translateLogicalToPhysical(logicalAddr + i, segBlocks));
+            }
+            return sim.chargeForwardAccesses(count);
+        }
+    };
+
+    // Drop the decoded program if cells [cell, cell + count) of the block hold code.
+    void invalidateDecodedRange(MemBlock *block, int cell, int count)
+    {
+        if (block->decoded && cell < block->decoded->codeEnd && cell + count > block->decoded->codeBegin)
+            block->decoded.reset(); // self-modifying code: back to the interpreter
+    }
+
+    // Store (opcode 3) and load (opcode 4), shared by both execution paths.
+    // Both return the cycles the access costs.
+    template <class Timing>
+    int executeStore(MemBlock *block, int value, int logicalAddr, const vector<MemBlock *> &segBlocks)
+    {
+        vector<int> &mem = block->content;
+        int processID = mem[PCBLayout::ID];
+        int relInstructionBase = mem[PCBLayout::INSTRUCTION_BASE];
+        int memoryLimit = mem[PCBLayout::MEMORY_LIMIT];
+        int physicalAddr = relInstructionBase + logicalAddr;
+        int translatedAddress;
+        int cycles = 1;
+        mem[PCBLayout::REGISTER] = value;
+        if (simOptions.profileMemory)
+            noteMemoryAccess(processID, logicalAddr, memoryLimit, true);
+        if (logicalAddr < memoryLimit)
+        {
+            mem[physicalAddr] = value;
+            invalidateDecodedRange(block, physicalAddr, 1);
+            if (!segBlocks.empty())
+                writeSegmentCell(segBlocks, segBlocks[0]->content[0] + 1 + physicalAddr, value);
+            translatedAddress = translateLogicalToPhysical(logicalAddr, segBlocks);
+            if (!segBlocks.empty())
+                cycles = Timing::access(*this, translatedAddress, segBlocks[0]->start, processID);
+
+            translatedAddress = translatedAddress;
+            out << "stored" << endl;
+            out << "Logical address " << logicalAddr << " translated to physical address "
+                 << translatedAddress << " for Process " << processID << endl;
+        }
+        else
+        {
+            out << "store error!" << endl;
+        }
+        return cycles;
+    }
+
+    template <class Timing>
+    int executeLoad(MemBlock *block, int logicalAddr, const vector<MemBlock *> &segBlocks)
+    {
+        vector<int> &mem = block->content;
+        int processID = mem[PCBLayout::ID];
+        int relInstructionBase = mem[PCBLayout::INSTRUCTION_BASE];
+        int memoryLimit = mem[PCBLayout::MEMORY_LIMIT];
+        int physicalAddr = relInstructionBase + logicalAddr;
+        int translatedAddress;
+        int cycles = 1;
+        if (simOptions.profileMemory)
+            noteMemoryAccess(processID, logicalAddr, memoryLimit, false);
+        if (logicalAddr < memoryLimit)
+        {
+            mem[PCBLayout::REGISTER] = mem[physicalAddr];
+            translatedAddress = translateLogicalToPhysical(logicalAddr, segBlocks);
+            if (!segBlocks.empty())
+                cycles = Timing::access(*this, translatedAddress, segBlocks[0]->start, processID);
+
+            translatedAddress = translatedAddress;
+            out << "loaded" << endl;
+            out << "Logical address " << logicalAddr << " translated to physical address "
+                 << translatedAddress << " for Process " << processID << endl;
+        }
+        else
+        {
+            out << "load error!" << endl;
+        }
+        return cycles;
+    }
+
+    // Taken jumps and loops per process, for SimOptions::jumpLimit.
+    unordered_map<int, long long> jumpsTaken;
+
+    // Past the limit the process is sent to the end of its program, which
+    // ends it the next time the core checks.
+    void countJump(int processID, int numInstructions, int &nextPC)
+    {
+        if (simOptions.jumpLimit <= 0 || ++jumpsTaken[processID] <= simOptions.jumpLimit)
+            return;
+        out << "Process " << processID << " exceeded the jump limit and was stopped." << endl;
+        nextPC = numInstructions;
+    }
+
+    // Opcodes 5-10, shared by both execution paths. Returns the cycles charged.
+    // nextPC comes in as the following instruction; a taken jump changes it.
+    template <class Timing>
+    int executeExtended(MemBlock *block, int opcode, const int *operands, int numInstructions, int &nextPC,
+                        const vector<MemBlock *> &segBlocks)
+    {
+        vector<int> &mem = block->content;
+        int processID = mem[PCBLayout::ID];
+        int relInstructionBase = mem[PCBLayout::INSTRUCTION_BASE];
+        int memoryLimit = mem[PCBLayout::MEMORY_LIMIT];
+        int imageBase = segBlocks.empty() ? 0 : segBlocks[0]->content[0] + 1;
+
+        if (opcode == Opcodes::JUMP || opcode == Opcodes::JUMP_IF_ZERO || opcode == Opcodes::JUMP_IF_NONZERO)
+        {
+            int target = operands[0];
+            if (target < 0 || target > numInstructions)
+            {
+                out << "jump error!" << endl;
+                return 1;
+            }
+            bool zero = mem[PCBLayout::REGISTER] == 0;
+            if (opcode == Opcodes::JUMP || (opcode == Opcodes::JUMP_IF_ZERO) == zero)
+            {
+                nextPC = target;
+                out << "jump to " << target << endl;
+                countJump(processID, numInstructions, nextPC);
+            }
+            else
+            {
+                out << "no jump" << endl;
+            }
+            return 1;
+        }
+
+        if (opcode == Opcodes::LOOP)
+        {
+            int counterAddr = operands[0];
+            int target = operands[1];
+            if (counterAddr < 0 || counterAddr >= memoryLimit || target < 0 || target > numInstructions)
+            {
+                out << "loop error!" << endl;
+                return 1;
+            }
+            if (simOptions.profileMemory)
+                noteMemoryAccess(processID, counterAddr, memoryLimit, true);
+            int cell = relInstructionBase + counterAddr;
+            int remaining = --mem[cell];
+            invalidateDecodedRange(block, cell, 1);
+            if (!segBlocks.empty())
+                writeSegmentCell(segBlocks, imageBase + cell, remaining);
+            int cycles = (int)Timing::accessRun(*this, counterAddr, 1, segBlocks, processID);
+            if (remaining > 0)
+            {
+                nextPC = target;
+                out << "loop to " << target << endl;
+                countJump(processID, numInstructions, nextPC);
+            }
+            else
+            {
+                out << "loop done" << endl;
+            }
+            return cycles;
+        }
+
+        // MEMSET value destination count, MEMCPY source destination count.
+        bool copy = opcode == Opcodes::MEMCPY;
+        int source = operands[0];
+        int destination = operands[1];
+        int count = operands[2];
+        bool sourceInRange = !copy || (source >= 0 && (long long)source + count <= memoryLimit);
+        if (count < 0 || destination < 0 || (long long)destination + count > memoryLimit || !sourceInRange)
+        {
+            out << (copy ? "memcpy error!" : "memset error!") << endl;
+            return 1;
+        }
+        if (simOptions.profileMemory)
+        {
+            for (int i = 0; copy && i < count; i++)
+                noteMemoryAccess(processID, source + i, memoryLimit, false);
+            for (int i = 0; i < count; i++)
+                noteMemoryAccess(processID, destination + i, memoryLimit, true);
+        }
+        int *dst = mem.data() + relInstructionBase + destination;
+        if (copy)
+            moveCells(dst, mem.data() + relInstructionBase + source, count);
+        else
+            fillCells(dst, source, count);
+        invalidateDecodedRange(block, relInstructionBase + destination, count);
+        if (!segBlocks.empty())
+            writeSegmentRun(segBlocks, imageBase + relInstructionBase + destination, dst, count);
+
+        long long cycles = Timing::accessRun(*this, destination, count, segBlocks, processID);
+        if (copy)
+        {
+            cycles += Timing::accessRun(*this, source, count, segBlocks, processID);
+            out << "memcpy " << count << " cells from logical address " << source << " to " << destination << endl;
+        }
+        else
+        {
+            out << "memset " << count << " cells at logical address " << destination << endl;
+        }
+        return (int)min<long long>(max<long long>(cycles, 1), INT_MAX);
+    }
+
+    template <class Timing, class Ops>
+    bool executeProcessCore(MemBlock *block,
+                            int &totalCpuCycles,
+                            int globalCPUAllocated,
+                            int startTime, const vector<MemBlock *> &segBlocks,
+                            int &ioBurst)
+    {
+        vector<int> &mem = block->content;
+        int processID = mem[PCBLayout::ID];
+        int &state = mem[PCBLayout::STATE];
+        int &relProgramCounter = mem[PCBLayout::PC];
+        int relInstructionBase = mem[PCBLayout::INSTRUCTION_BASE];
+        int relDataBase = mem[PCBLayout::DATA_BASE];
+        int memoryLimit = mem[PCBLayout::MEMORY_LIMIT];
+        int &cpuCyclesUsed = mem[PCBLayout::CPU_CYCLES];
+        int &registerValue = mem[PCBLayout::REGISTER];
+        int maxMemoryNeeded = mem[PCBLayout::MAX_MEMORY];
+        int mainMemoryBase = segBlocks.empty() ? mem[PCBLayout::MAIN_MEMORY_BASE] : segBlocks[0]->start;
+
+        out << "Process " << processID << " has moved to Running." << endl;
+        noteEvent(EVENT_DISPATCHED, processID, totalCpuCycles);
+        state = STATE_RUNNING;
+
+        int timeSliceCounter = 0;
+        bool brokeEarly = false;
+        int numInstructions = relDataBase - relInstructionBase;
+
+        // Fast path over the decoded program. It stops early (and the loop below
+        // takes over mid-slice) if a store overwrites the code.
+        shared_ptr<const DecodedProgram> decoded = block->decoded;
+        while (block->decoded && relProgramCounter < numInstructions)
+        {
+            const DecodedProgram &prog = *block->decoded;
+            const DecodedOp &op = prog.ops[relProgramCounter];
+            int nextPC = relProgramCounter + 1;
+            if (op.opcode == Opcodes::COMPUTE && prog.fusable)
+            {
+                // Superinstruction: retire compute instructions up to the end of
+                // the run, or up to the first one that exhausts the time slice.
+                int pc = relProgramCounter;
+                int runEnd = prog.runEnd[pc];
+                long long target = (long long)globalCPUAllocated - timeSliceCounter + prog.computePrefix[pc];
+                const long long *first = prog.computePrefix.data() + pc + 1;
+                const long long *last = prog.computePrefix.data() + runEnd + 1;
+                const long long *hit = lower_bound(first, last, target);
+                int stop = (hit == last) ? runEnd : (int)(hit - prog.computePrefix.data());
+                int cpuCycles = (int)(prog.computePrefix[stop] - prog.computePrefix[pc]);
+                cpuCyclesUsed += cpuCycles;
+                timeSliceCounter += cpuCycles;
+                updateClock(totalCpuCycles, cpuCycles, "compute");
+                printComputeLines(stop - pc);
+                relProgramCounter = stop;
+                if (hit != last && stop < numInstructions)
+                {
+                    out << "Process " << processID
+                         << " has a TimeOUT interrupt and is moved to the ReadyQueue." << endl;
+                    noteEvent(EVENT_PREEMPTED, processID, totalCpuCycles);
+                    brokeEarly = true;
+                    break;
+                }
+                continue;
+            }
+            if (op.opcode == Opcodes::COMPUTE)
+            {
+                cpuCyclesUsed += op.b;
+                timeSliceCounter += op.b;
+                updateClock(totalCpuCycles, op.b, "compute");
+                out << "compute" << endl;
+            }
+            else if (op.opcode == Opcodes::PRINT)
+            {
+                cpuCyclesUsed += op.a;
+                timeSliceCounter += op.a;
+                relProgramCounter++;
+                state = STATE_IO_WAITING;
+                ioBurst = op.a;
+                out << "Process " << processID
+                     << " issued an IOInterrupt and moved to the IOWaitingQueue." << endl;
+                noteEvent(EVENT_IO_WAIT, processID, totalCpuCycles);
+                brokeEarly = true;
+                break;
+            }
+            else if (op.opcode == Opcodes::STORE || op.opcode == Opcodes::LOAD)
+            {
+                bool store = op.opcode == Opcodes::STORE;
+                int cycles = store ? executeStore<Timing>(block, op.a, op.b, segBlocks)
+                                   : executeLoad<Timing>(block, op.a, segBlocks);
+                cpuCyclesUsed += cycles;
+                timeSliceCounter += cycles;
+                updateClock(totalCpuCycles, cycles, store ? "store" : "load");
+            }
+            else if (Ops::extended && Ops::arity(op.opcode) > 0)
+            {
+                int operands[MAX_OPERANDS] = {op.a, op.b, op.c};
+                int cycles = executeExtended<Timing>(block, op.opcode, operands, numInstructions, nextPC, segBlocks);
+                cpuCyclesUsed += cycles;
+                timeSliceCounter += cycles;
+                updateClock(totalCpuCycles, cycles, "extended");
+            }
+            relProgramCounter = nextPC;
+            bool endOfInstructions = relProgramCounter >= numInstructions;
+            if (timeSliceCounter >= globalCPUAllocated && !endOfInstructions)
+            {
+                out << "Process " << processID
+                     << " has a TimeOUT interrupt and is moved to the ReadyQueue." << endl;
+                noteEvent(EVENT_PREEMPTED, processID, totalCpuCycles);
+                brokeEarly = true;
+                break;
+            }
+        }
+
+        // Continue with the operand cursor the decoded run reached, which is what
+        // the interpreter would hold even if the code was just overwritten.
+        int operandPointer = decoded ? decoded->operandOffset[min(relProgramCounter, numInstructions)]
+                                     : computeOperandPointerFromBlock<Ops>(mem, relInstructionBase, relDataBase, relProgramCounter);
+
+        while (!brokeEarly && (relInstructionBase + relProgramCounter) < relDataBase)
+        {
+            int opcode = mem[relInstructionBase + relProgramCounter];
+            int numOperands = Ops::arity(opcode);
+            int operands[MAX_OPERANDS] = {0, 0, 0};
+            for (int i = 0; i < numOperands; i++)
+            {
+                operands[i] = mem[operandPointer++];
+            }
+            int nextPC = relProgramCounter + 1;
+            if (opcode == Opcodes::COMPUTE)
+            {
+                int cpuCycles = operands[1];
+                cpuCyclesUsed += cpuCycles;
+                timeSliceCounter += cpuCycles;
+                updateClock(totalCpuCycles, cpuCycles, "compute");
+                out << "compute" << endl;
+            }
+            else if (opcode == Opcodes::PRINT)
+            {
+                int cpuCycles = operands[0];
+                cpuCyclesUsed += cpuCycles;
+                timeSliceCounter += cpuCycles;
+                relProgramCounter++;
+                state = STATE_IO_WAITING;
+                ioBurst = cpuCycles;
+                out << "Process " << processID
+                     << " issued an IOInterrupt and moved to the IOWaitingQueue." << endl;
+                noteEvent(EVENT_IO_WAIT, processID, totalCpuCycles);
+                brokeEarly = true;
+                break;
+            }
+            else if (opcode == Opcodes::STORE)
+            {
+                int cycles = executeStore<Timing>(block, operands[0], operands[1], segBlocks);
+                cpuCyclesUsed += cycles;
+                timeSliceCounter += cycles;
+                updateClock(totalCpuCycles, cycles, "store");
+            }
+            else if (opcode == Opcodes::LOAD)
+            {
+                int cycles = executeLoad<Timing>(block, operands[0], segBlocks);
+                cpuCyclesUsed += cycles;
+                timeSliceCounter += cycles;
+                updateClock(totalCpuCycles, cycles, "load");
+            }
+            else if (Ops::extended && numOperands > 0)
+            {
+                int cycles = executeExtended<Timing>(block, opcode, operands, numInstructions, nextPC, segBlocks);
+                cpuCyclesUsed += cycles;
+                timeSliceCounter += cycles;
+                updateClock(totalCpuCycles, cycles, "extended");
+                // The operand cursor follows the instruction, not the path taken.
+                if (nextPC != relProgramCounter + 1)
+                    operandPointer = computeOperandPointerFromBlock<Ops>(mem, relInstructionBase, relDataBase, nextPC);
+            }
+            if (!brokeEarly)
+            {
+                relProgramCounter = nextPC;
+            }
+            bool endOfInstructions = ((relInstructionBase + relProgramCounter) >= relDataBase);
+            if (!brokeEarly && timeSliceCounter >= globalCPUAllocated && !endOfInstructions)
+            {
+                out << "Process " << processID
+                     << " has a TimeOUT interrupt and is moved to the ReadyQueue." << endl;
+                noteEvent(EVENT_PREEMPTED, processID, totalCpuCycles);
+                brokeEarly = true;
+                break;
+            }
+        }
+        bool finishedAll = ((relInstructionBase + relProgramCounter) >= relDataBase);
+        if (!brokeEarly && finishedAll)
+        {
+            state = STATE_TERMINATED;
+            int physicalPC = mainMemoryBase + relProgramCounter;
+            int physicalInstructionBase = mainMemoryBase + relInstructionBase;
+            int physicalDataBase = mainMemoryBase + relDataBase;
+            int segTableSize = segBlocks.empty() ? mem[PCBLayout::ID] : segBlocks[0]->content[0];
+            int bias;
+
+            out << "Process ID: " << processID << "\n"
+                 << "State: TERMINATED\n"
+                 << "Program Counter: " << (segTableSize + 10) << "\n"
+                 << "Instruction Base: " << segTableSize + 11 << "\n"
+                 << "Data Base: " << relDataBase + segTableSize + 1 << "\n"
+                 << "Memory Limit: " << memoryLimit << "\n"
+                 << "CPU Cycles Used: " << cpuCyclesUsed << "\n"
+                 << "Register Value: " << registerValue << "\n"
+                 << "Max Memory Needed: " << maxMemoryNeeded << "\n"
+                 << "Main Memory Base: " << mainMemoryBase << "\n"
+                 << "Total CPU Cycles Consumed: " << (totalCpuCycles - startTime) << "\n";
+
+            out << "Process " << processID
+                 << " terminated. Entered running state at: " << startTime
+                 << ". Terminated at: " << totalCpuCycles
+                 << ". Total Execution Time: "
+                 << (totalCpuCycles - startTime)
+                 << "." << endl;
+
+            syncPCBToSegments(mem, segBlocks);
+            return true;
+        }
+        syncPCBToSegments(mem, segBlocks);
+        return false;
+    }
+
+    // Run one time slice. The opcode set and the timing policy are chosen
+    // here, once per slice.
+    bool executeProcess(MemBlock *block,
+                        int &totalCpuCycles,
+                        int globalCPUAllocated,
+                        int startTime, const vector<MemBlock *> &segBlocks,
+                        int &ioBurst)
+    {
+        ScopedTimer timer(hostTimer(HOST_EXECUTE));
+        if (simOptions.extendedOpcodes)
+            return executeSlice<ExtendedOpcodeSet>(block, totalCpuCycles, globalCPUAllocated, startTime, segBlocks,
+                                                   ioBurst);
+        return executeSlice<BaseOpcodeSet>(block, totalCpuCycles, globalCPUAllocated, startTime, segBlocks, ioBurst);
+    }
+
+    template <class Ops>
+    bool executeSlice(MemBlock *block, int &totalCpuCycles, int globalCPUAllocated, int startTime,
+                      const vector<MemBlock *> &segBlocks, int &ioBurst)
+    {
+        if (simOptions.sampleDetailed > 0)
+            return executeSampledSlice<Ops>(block, totalCpuCycles, globalCPUAllocated, startTime, segBlocks, ioBurst);
+        if (banksEnabled() || cachesEnabled())
+            return executeProcessCore<ModelledTiming, Ops>(block, totalCpuCycles, globalCPUAllocated, startTime,
+                                                           segBlocks, ioBurst);
+        return executeProcessCore<FlatTiming, Ops>(block, totalCpuCycles, globalCPUAllocated, startTime, segBlocks,
+                                                   ioBurst);
+    }
+
+    // -------------------------------------------------------------------------
+    // Sampled Simulation
+    // -------------------------------------------------------------------------
+    // With --sample=D,F[,W] time slices are taken in periods of W + D + F, as
+    // in SMARTS. Each period simulates W + D consecutive slices in detail,
+    // starting at a random slice so the measured slices do not fall in step
+    // with the round robin; the first W of them only warm the timing state up
+    // and the next D are measured. The other F slices are fast-forwarded. A
+    // fast-forwarded slice still executes every instruction, since loads,
+    // jumps and loops decide what runs next, but with its output discarded:
+    // compute costs come from the instructions as usual, the caches see every
+    // access so they are not cold when measuring resumes (functional warming),
+    // and each access is charged the mean access cost measured so far for its
+    // process, carried over in fractions so the clock stays right on average.
+    // Without banks or caches every access costs one cycle and a sampled run
+    // keeps the timing of a full one.
+    //
+    // Processes are kept apart because their costs differ (home bank,
+    // locality) and a process charged too little gets fewer slices, so one
+    // pooled mean would be measured mostly on the cheap ones. The cost of each
+    // process is a ratio estimate over its measured slices, falling back to
+    // the pooled one until it has two. Their standard errors give 95%
+    // confidence intervals for throughput, mean turnaround and utilisation
+    // through the fast-forwarded accesses each figure depends on. The
+    // intervals do not cover the scheduling shifts a different clock would
+    // cause; --sample-validate measures those against a full run.
+
+    struct CostSample
+    {
+        // Sums over measured slices for the ratio estimate.
+        double slices = 0;
+        double accesses = 0;
+        double cycles = 0;
+        double accessesSquared = 0;
+        double cyclesSquared = 0;
+        double crossProduct = 0;
+        long long forwardAccesses = 0;
+
+        void add(double a, double c)
+        {
+            slices++;
+            accesses += a;
+            cycles += c;
+            accessesSquared += a * a;
+            cyclesSquared += c * c;
+            crossProduct += a * c;
+        }
+
+        bool measured() const
+        {
+            return slices >= 2 && accesses > 0;
+        }
+
+        double mean() const
+        {
+            return accesses > 0 ? cycles / accesses : 1.0;
+        }
+
+        // Standard error of the ratio estimate.
+        double error() const
+        {
+            if (!measured())
+                return 0;
+            double cost = mean();
+            double residual = cyclesSquared - 2 * cost * crossProduct + cost * cost * accessesSquared;
+            double meanAccesses = accesses / slices;
+            return sqrt(max(0.0, residual) / (slices * (slices - 1))) / meanAccesses;
+        }
+    };
+
+    struct SamplingState
+    {
+        long long slices = 0;
+        long long warmupSlices = 0;
+        long long detailedSlices = 0;
+        long long forwardSlices = 0;
+        // Accesses and their cycles in the measured slice that is running.
+        long long sliceAccesses = 0;
+        long long sliceAccessCycles = 0;
+        CostSample pooled;
+        unordered_map<int, CostSample> processes;
+        // Fast-forwarded accesses, the fraction of a cycle owed, and the sum
+        // over finished processes of the ones made during their lifetime.
+        long long forwardAccesses = 0;
+        double carry = 0;
+        double lifetimeForwardAccesses = 0;
+        // Where the detailed slices start in the current period.
+        long long detailedStart = 0;
+        // The process of the fast-forwarded slice that is running.
+        CostSample *current = nullptr;
+        double currentCost = 1.0;
+        // Output is off between fast-forwarded slices (setSamplingQuiet).
+        bool quiet = false;
+        ios::iostate outputState = ios::goodbit;
+        workload::Rng rng = workload::Rng(1);
+    };
+
+    SamplingState sampling;
+
+    const CostSample &costSampleFor(const CostSample &process)
+    {
+        return process.measured() ? process : sampling.pooled;
+    }
+
+    // Fill the caches as a timed access would, without charging for it. The
+    // per-level hit and miss counts include these accesses.
+    void warmCaches(int address)
+    {
+        if (!cachesEnabled() || address < 0)
+            return;
+        for (CacheLevel &level : cacheLevels)
+        {
+            if (level.access(address))
+                return;
+        }
+    }
+
+    // The process and its cost are looked up once per fast-forwarded slice.
+    long long chargeForwardAccesses(int count)
+    {
+        sampling.current->forwardAccesses += count;
+        sampling.forwardAccesses += count;
+        sampling.carry += sampling.currentCost * count;
+        long long cycles = (long long)sampling.carry;
+        sampling.carry -= (double)cycles;
+        return cycles;
+    }
+
+    template <class Timing, class Ops>
+    bool executeMeasuredSlice(MemBlock *block, int &totalCpuCycles, int globalCPUAllocated, int startTime,
+                              const vector<MemBlock *> &segBlocks, int &ioBurst)
+    {
+        sampling.sliceAccesses = 0;
+        sampling.sliceAccessCycles = 0;
+        int processID = block->content[PCBLayout::ID];
+        bool finished = executeProcessCore<MeasuredTiming<Timing>, Ops>(block, totalCpuCycles, globalCPUAllocated,
+                                                                        startTime, segBlocks, ioBurst);
+        double a = (double)sampling.sliceAccesses;
+        double c = (double)sampling.sliceAccessCycles;
+        sampling.pooled.add(a, c);
+        sampling.processes[processID].add(a, c);
+        return finished;
+    }
+
+    template <class Ops>
+    bool executeSampledSlice(MemBlock *block, int &totalCpuCycles, int globalCPUAllocated, int startTime,
+                             const vector<MemBlock *> &segBlocks, int &ioBurst)
+    {
+        bool modelled = banksEnabled() || cachesEnabled();
+        long long period = (long long)simOptions.sampleWarmup + simOptions.sampleDetailed + simOptions.sampleForward;
+        long long position = sampling.slices++ % period;
+        if (position == 0)
+            sampling.detailedStart = sampling.rng.range(0, simOptions.sampleForward);
+        long long offset = position - sampling.detailedStart;
+        bool detailed = offset >= 0 && offset < simOptions.sampleWarmup + simOptions.sampleDetailed;
+        setSamplingQuiet(!detailed);
+        if (offset >= 0 && offset < simOptions.sampleWarmup)
+        {
+            sampling.warmupSlices++;
+            if (modelled)
+                return executeProcessCore<ModelledTiming, Ops>(block, totalCpuCycles, globalCPUAllocated, startTime,
+                                                               segBlocks, ioBurst);
+            return executeProcessCore<FlatTiming, Ops>(block, totalCpuCycles, globalCPUAllocated, startTime,
+                                                       segBlocks, ioBurst);
+        }
+        if (detailed)
+        {
+            sampling.detailedSlices++;
+            if (modelled)
+                return executeMeasuredSlice<ModelledTiming, Ops>(block, totalCpuCycles, globalCPUAllocated,
+                                                                 startTime, segBlocks, ioBurst);
+            return executeMeasuredSlice<FlatTiming, Ops>(block, totalCpuCycles, globalCPUAllocated, startTime,
+                                                         segBlocks, ioBurst);
+        }
+        sampling.forwardSlices++;
+        sampling.current = &sampling.processes[block->content[PCBLayout::ID]];
+        sampling.currentCost = costSampleFor(*sampling.current).mean();
+        return executeProcessCore<ForwardTiming, Ops>(block, totalCpuCycles, globalCPUAllocated, startTime,
+                                                      segBlocks, ioBurst);
+    }
+
+    // From the first fast-forwarded slice to the next detailed one nothing is
+    // printed, admissions and I/O in between included. Marking the stream
+    // failed makes every write return before any formatting is done.
+    void setSamplingQuiet(bool quiet)
+    {
+        if (quiet == sampling.quiet)
+            return;
+        if (quiet)
+        {
+            sampling.outputState = out.rdstate();
+            out.setstate(ios::badbit);
+        }
+        else
+        {
+            out.clear(sampling.outputState);
+        }
+        sampling.quiet = quiet;
+    }
+
+    // Confidence intervals for the run's figures. The error in the total CPU
+    // time adds up over the processes' fast-forwarded accesses; processes
+    // charged the pooled cost share its error, so theirs add up first.
+    void estimateSamplingError()
+    {
+        const double z = 1.96;
+        double pooledAccesses = 0;
+        double variance = 0;
+        for (const auto &entry : sampling.processes)
+        {
+            const CostSample &process = entry.second;
+            if (!process.measured())
+            {
+                pooledAccesses += process.forwardAccesses;
+                continue;
+            }
+            double spread = process.forwardAccesses * process.error();
+            variance += spread * spread;
+        }
+        double pooledSpread = pooledAccesses * sampling.pooled.error();
+        double timeError = sqrt(variance + pooledSpread * pooledSpread);
+
+        double total = (double)totalCpuCycles;
+        double busy = (double)busyCycles;
+        double forward = (double)sampling.forwardAccesses;
+        result.sampled = true;
+        SamplingSummary &summary = result.sampling;
+        summary.warmupSlices = sampling.warmupSlices;
+        summary.detailedSlices = sampling.detailedSlices;
+        summary.forwardSlices = sampling.forwardSlices;
+        summary.measuredAccesses = (long long)sampling.pooled.accesses;
+        summary.forwardAccesses = sampling.forwardAccesses;
+        summary.accessCost.value = sampling.pooled.mean();
+        summary.accessCost.halfWidth = z * sampling.pooled.error();
+        if (total <= 0)
+            return;
+        // Every fast-forwarded access lies in a time slice, so it moves both
+        // the total and the busy cycles. A job's turnaround takes the share of
+        // the error made while it was in the system.
+        result.throughput.halfWidth = z * timeError * 1000.0 * finishedJobs / (total * total);
+        result.utilisation.halfWidth = z * timeError * (total - busy) / (total * total);
+        if (finishedJobs > 0 && forward > 0)
+            result.turnaround.halfWidth = z * timeError * sampling.lifetimeForwardAccesses / (forward * finishedJobs);
+    }
+
+    void printSamplingReport()
+    {
+        const SamplingSummary &summary = result.sampling;
+        out << "----- Sampling Report -----" << endl;
+        out << "Time slices: " << summary.detailedSlices << " measured, " << summary.warmupSlices << " warm-up, "
+            << summary.forwardSlices << " fast-forwarded" << endl;
+        out << "Memory accesses: " << summary.measuredAccesses << " measured, " << summary.forwardAccesses
+            << " fast-forwarded" << endl;
+        out << "Access cost: " << summary.accessCost.value << " +/- " << summary.accessCost.halfWidth
+            << " cycles (pooled over " << sampling.processes.size() << " processes)" << endl;
+        out << "Throughput: " << result.throughput.value << " +/- " << result.throughput.halfWidth
+            << " jobs per 1000 cycles" << endl;
+        out << "Turnaround: mean " << result.turnaround.value << " +/- " << result.turnaround.halfWidth << endl;
+        out << "Utilisation: " << result.utilisation.value << " +/- " << result.utilisation.halfWidth << endl;
+        out << "(95% intervals for the access cost only; --sample-validate measures the full error)" << endl;
+        out << "---------------------------" << endl;
+    }
+
+    // -------------------------------------------------------------------------
+    // Core Benchmark
+    // -------------------------------------------------------------------------
+    // --bench-core=N runs one synthetic program N times through the execution
+    // core for each pairing of memory timing (modelled, flat) and opcode set
+    // (extended, base), all over the same decoded program, and prints the time
+    // per instruction of each. The speedup compares the most general core
+    // (modelled, extended) with the most specialised one (flat, base). The
+    // runs print nothing.
+
+    // Time 'runs' complete executions of the loaded program, restoring both
+    // images and the decoded program after each one. Returns nanoseconds.
+    template <class Timing, class Ops>
+    double timeCoreRuns(MemBlock *block, vector<MemBlock *> &segments, int runs)
+    {
+        vector<int> blockImage = block->content;
+        shared_ptr<const DecodedProgram> decoded = block->decoded;
+        vector<vector<int>> segmentImages;
+        for (MemBlock *seg : segments)
+            segmentImages.push_back(seg->content);
+
+        double total = 0;
+        for (int r = 0; r < runs; r++)
+        {
+            int cycles = 0;
+            int ioBurst = 0;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            executeProcessCore<Timing, Ops>(block, cycles, INT_MAX, 0, segments, ioBurst);
+            total += chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+            block->content = blockImage;
+            block->decoded = decoded; // a store into the code drops it
+            for (size_t i = 0; i < segments.size(); i++)
+                segments[i]->content = segmentImages[i];
+        }
+        return total;
+    }
+
+    int runCoreBenchmark(int runs)
+    {
+        workload::GeneratorConfig cfg;
+        cfg.seed = 7;
+        cfg.numProcesses = 1;
+        cfg.instructionCount = workload::Distribution(workload::DIST_FIXED, 5000, 0);
+        cfg.memorySize = workload::Distribution(workload::DIST_FIXED, 20000, 0);
+        cfg.opMix[1] = 0; // no prints, so every run finishes in one slice
+        workload::Generator gen(cfg);
+        workload::GeneratedProcess generated;
+        gen.next(generated);
+        Process job;
+        job.processID = generated.processID;
+        job.maxMemoryNeeded = generated.maxMemoryNeeded;
+        job.numInstructions = generated.numInstructions;
+        job.instructions = generated.instructions;
+        // Keep stores out of the code so every run executes the same
+        // instructions and the decoded program is never dropped.
+        int codeCells = (int)job.instructions.size();
+        int dataCells = job.maxMemoryNeeded - codeCells;
+        for (size_t i = 0; i < job.instructions.size() && dataCells > 0;
+             i += 1 + BaseOpcodeSet::arity(job.instructions[i]))
+        {
+            if (job.instructions[i] == Opcodes::STORE)
+                job.instructions[i + 2] = codeCells + job.instructions[i + 2] % dataCells;
+        }
+
+        int memorySize = job.maxMemoryNeeded * 2;
+        physicalMemory.assign(memorySize, -1);
+        MemBlock *segmentList = initDynamicMemory(memorySize);
+        MemBlock *logicalList = initDynamicMemory(memorySize);
+        int allocError = 0;
+        vector<MemBlock *> segments = allocateProcessSegments(segmentList, job, allocError);
+        MemBlock *block = allocateMemoryForJob(logicalList, job);
+        if (segments.empty() || block == nullptr)
+        {
+            out << "Error: benchmark program does not fit" << endl;
+            return 1;
+        }
+
+        // Every pairing runs the same decoded program (the generator only
+        // emits base opcodes, which decode alike in both sets). badbit makes
+        // every insertion return at once, so no output is formatted while
+        // timing.
+        loadJobIntoSegments(job, segments);
+        loadJobIntoBlock(job, block);
+        ios::iostate state = out.rdstate();
+        out.setstate(ios::badbit);
+        double modelledExtended = timeCoreRuns<ModelledTiming, ExtendedOpcodeSet>(block, segments, runs);
+        double modelledBase = timeCoreRuns<ModelledTiming, BaseOpcodeSet>(block, segments, runs);
+        double flatExtended = timeCoreRuns<FlatTiming, ExtendedOpcodeSet>(block, segments, runs);
+        double flatBase = timeCoreRuns<FlatTiming, BaseOpcodeSet>(block, segments, runs);
+        out.clear(state);
+
+        double instructions = (double)job.numInstructions * runs;
+        out << "----- Core Benchmark -----" << endl;
+        out << "Program: " << job.numInstructions << " instructions, " << runs << " runs" << endl;
+        out << "Fused instructions: " << (simOptions.fuseInstructions ? "on" : "off") << endl;
+        out << "Modelled timing, extended opcodes: " << modelledExtended / instructions << " ns/instruction" << endl;
+        out << "Modelled timing, base opcodes: " << modelledBase / instructions << " ns/instruction" << endl;
+        out << "Flat timing, extended opcodes: " << flatExtended / instructions << " ns/instruction" << endl;
+        out << "Flat timing, base opcodes: " << flatBase / instructions << " ns/instruction" << endl;
+        out << "Speedup: " << (flatBase > 0 ? modelledExtended / flatBase : 0) << "x" << endl;
+        out << "--------------------------" << endl;
+        return 0;
+    }
+
+    // -------------------------------------------------------------------------
+    // I/O Handling
+    // -------------------------------------------------------------------------
+    // Print instructions become requests on one of the configured I/O devices.
+    // Each device has its own request queue, a limit on requests in service at
+    // once and a service-time model. With no --io-device options there is one
+    // FCFS device with unlimited slots and a service time equal to the print
+    // operand, which is the original single ioQueue.
+
+    struct IORequest
+    {
+        MemBlock *block;
+        int processID;
+        int processIndex; // in processes
+        int burst;      // print operand
+        int position;   // track the request seeks to (SSTF)
+        int priority;   // lower is served first (PRIORITY)
+        int issueTime;
+        int startTime;
+        int completionTime;
+        long long seq;  // global issue order
+        bool swappedOut = false; // the process's image went to swap while waiting
+    };
+
+    struct IODevice
+    {
+        IODeviceConfig config;
+        vector<IORequest> pending;   // waiting for a free slot
+        vector<IORequest> inService; // being serviced
+        int headPosition = 0;
+
+        // Statistics.
+        long long served = 0;
+        long long totalQueueWait = 0;
+        long long totalService = 0;
+        size_t maxQueueDepth = 0;
+    };
+
+    struct IOSubsystem
+    {
+        vector<IODevice> devices;
+        workload::Rng rng = workload::Rng(12345);
+        long long nextSeq = 0;
+        // Processes whose I/O finished while they were swapped out, in order,
+        // as their PCB block and index in processes.
+        queue<pair<MemBlock *, int>> swapInQueue;
+
+        bool empty() const
+        {
+            for (const IODevice &dev : devices)
+            {
+                if (!dev.pending.empty() || !dev.inService.empty())
+                    return false;
+            }
+            return true;
+        }
+
+        size_t size() const
+        {
+            size_t n = 0;
+            for (const IODevice &dev : devices)
+                n += dev.pending.size() + dev.inService.size();
+            return n;
+        }
+    };
+
+    void initIOSubsystem(IOSubsystem &io)
+    {
+        io.devices.clear();
+        vector<IODeviceConfig> configs = simOptions.ioDevices;
+        if (configs.empty())
+            configs.push_back(IODeviceConfig());
+        for (const IODeviceConfig &cfg : configs)
+        {
+            IODevice dev;
+            dev.config = cfg;
+            io.devices.push_back(dev);
+        }
+    }
+
+    // Service time of a request on a device, including the seek for SSTF devices.
+    int ioServiceTime(IOSubsystem &io, IODevice &dev, const IORequest &req)
+    {
+        double base = req.burst * dev.config.scale;
+        double t = base;
+        switch (dev.config.latency)
+        {
+        case IO_LATENCY_FIXED:
+            break;
+        case IO_LATENCY_UNIFORM:
+            t = base * (1.0 + dev.config.jitter * (2.0 * io.rng.unit() - 1.0));
+            break;
+        case IO_LATENCY_EXP:
+            t = -base * log(1.0 - io.rng.unit());
+            break;
+        }
+        t += dev.config.seekCost * abs(req.position - dev.headPosition);
+        int cycles = (int)(t + 0.5);
+        return cycles < 0 ? 0 : cycles;
+    }
+
+    // Pick the pending request the device's discipline serves next.
+    size_t pickIORequest(const IODevice &dev)
+    {
+        size_t best = 0;
+        for (size_t i = 1; i < dev.pending.size(); i++)
+        {
+            const IORequest &a = dev.pending[i];
+            const IORequest &b = dev.pending[best];
+            bool better = false;
+            if (dev.config.discipline == IO_PRIORITY)
+                better = a.priority < b.priority || (a.priority == b.priority && a.seq < b.seq);
+            else if (dev.config.discipline == IO_SSTF)
+            {
+                int da = abs(a.position - dev.headPosition);
+                int db = abs(b.position - dev.headPosition);
+                better = da < db || (da == db && a.seq < b.seq);
+            }
+            else
+                better = a.seq < b.seq;
+            if (better)
+                best = i;
+        }
+        return best;
+    }
+
+    // Move pending requests into free slots, starting them at time 'now'.
+    void startIORequests(IOSubsystem &io, IODevice &dev, int now)
+    {
+        int slots = dev.config.concurrency;
+        while (!dev.pending.empty() && (slots <= 0 || (int)dev.inService.size() < slots))
+        {
+            size_t k = pickIORequest(dev);
+            IORequest req = dev.pending[k];
+            dev.pending.erase(dev.pending.begin() + k);
+            req.startTime = now;
+            req.completionTime = now + ioServiceTime(io, dev, req);
+            dev.headPosition = req.position;
+            dev.totalQueueWait += req.startTime - req.issueTime;
+            dev.totalService += req.completionTime - req.startTime;
+            dev.inService.push_back(req);
+        }
+    }
+
+    // Queue an I/O request for the process in 'block'.
+    void submitIORequest(IOSubsystem &io, MemBlock *block, int processIndex, int burst, int cpuCyclesUsed, int now)
+    {
+        int processID = block->content[PCBLayout::ID];
+        IODevice &dev = io.devices[(processID % io.devices.size() + io.devices.size()) % io.devices.size()];
+        IORequest req;
+        req.block = block;
+        req.processID = processID;
+        req.processIndex = processIndex;
+        req.burst = burst;
+        req.position = dev.config.tracks > 0 ? (int)(((long long)processID * 7919) % dev.config.tracks) : 0;
+        req.priority = cpuCyclesUsed; // favour I/O-bound processes
+        req.issueTime = now;
+        req.startTime = -1;
+        req.completionTime = -1;
+        req.seq = io.nextSeq++;
+        dev.pending.push_back(req);
+        dev.maxQueueDepth = max(dev.maxQueueDepth, dev.pending.size());
+        startIORequests(io, dev, now);
+    }
+
+    void checkIOQueueSimultaneously(IOSubsystem &io,
+                                    queue<MemBlock *> &readyQueue,
+                                    int &totalCpuCycles)
+    {
+        ScopedTimer timer(hostTimer(HOST_IO_POLL));
+        vector<IORequest> completed;
+        for (IODevice &dev : io.devices)
+        {
+            // Retire requests in completion order so the requests they free slots
+            // for start at the right cycle, which may also be before now.
+            while (true)
+            {
+                int k = -1;
+                for (int i = 0; i < (int)dev.inService.size(); i++)
+                {
+                    if (dev.inService[i].completionTime <= totalCpuCycles &&
+                        (k == -1 || dev.inService[i].completionTime < dev.inService[k].completionTime))
+                        k = i;
+                }
+                if (k == -1)
+                    break;
+                IORequest done = dev.inService[k];
+                dev.inService.erase(dev.inService.begin() + k);
+                dev.served++;
+                completed.push_back(done);
+                startIORequests(io, dev, done.completionTime);
+            }
+        }
+
+        // Requests found complete in the same poll enter the ReadyQueue in issue order.
+        sort(completed.begin(), completed.end(),
+             [](const IORequest &a, const IORequest &b)
+             { return a.seq < b.seq; });
+        for (const IORequest &req : completed)
+        {
+            req.block->content[PCBLayout::STATE] = STATE_NEW; // done waiting
+            if (req.swappedOut)
+            {
+                out << "print" << endl;
+                out << "Process " << req.processID
+                     << " completed I/O and is waiting to be swapped in." << endl;
+                noteEvent(EVENT_IO_DONE, req.processID, req.completionTime);
+                io.swapInQueue.push({req.block, req.processIndex});
+                continue;
+            }
+            out << "print" << endl;
+            out << "Process " << req.processID
+                 << " completed I/O and is moved to the ReadyQueue." << endl;
+            noteEvent(EVENT_IO_DONE, req.processID, req.completionTime);
+            readyQueue.push(req.block);
+        }
+    }
+
+    void printIOReport(const IOSubsystem &io, int totalCpuCycles)
+    {
+        out << "----- I/O Device Report -----" << endl;
+        for (const IODevice &dev : io.devices)
+        {
+            double meanWait = dev.served ? (double)dev.totalQueueWait / dev.served : 0.0;
+            double meanService = dev.served ? (double)dev.totalService / dev.served : 0.0;
+            out << "Device " << dev.config.name
+                 << ": requests " << dev.served
+                 << ", mean queue wait " << meanWait
+                 << ", mean service " << meanService
+                 << ", max queue depth " << dev.maxQueueDepth;
+            if (dev.config.concurrency > 0 && totalCpuCycles > 0)
+            {
+                double utilization = (double)dev.totalService / ((double)dev.config.concurrency * totalCpuCycles);
+                out << ", utilization " << utilization;
+            }
+            out << endl;
+        }
+        out << "-----------------------------" << endl;
+    }
+
+    // -------------------------------------------------------------------------
+    // Swapping
+    // -------------------------------------------------------------------------
+    // When the job at the head of the NewJobQueue does not fit, the swapper picks
+    // processes that have been blocked on I/O for a while, writes their segmented
+    // image to a swap file and frees their segments. The contiguous execution
+    // block stays where it is. When the I/O completes the image is read back into
+    // freshly allocated segments before the process rejoins the ReadyQueue.
+
+    struct SwapStats
+    {
+        long long swapOuts = 0;
+        long long swapIns = 0;
+        long long cellsOut = 0;
+        long long cellsIn = 0;
+        long long cycles = 0;
+        int swappedNow = 0;
+        int peakSwapped = 0;
+        long long peakSwapCells = 0;
+        int peakResident = 0; // most processes holding segments at once
+    };
+
+    SwapStats swapStats;
+    fstream swapStream;
+    long long swapFileCells = 0;                     // high-water mark of the file
+    vector<pair<long long, int>> freeSwapExtents;   // (offset, cells) free for reuse
+
+    bool openSwapFile()
+    {
+        swapStream.open(simOptions.swapFile.c_str(), ios::in | ios::out | ios::binary | ios::trunc);
+        return swapStream.is_open();
+    }
+
+    void closeSwapFile()
+    {
+        if (swapStream.is_open())
+        {
+            swapStream.close();
+            remove(simOptions.swapFile.c_str());
+        }
+    }
+
+    // First-fit slot in the swap file; grows the file when nothing fits.
+    long long allocateSwapSlot(int cells)
+    {
+        for (size_t i = 0; i < freeSwapExtents.size(); i++)
+        {
+            if (freeSwapExtents[i].second >= cells)
+            {
+                long long offset = freeSwapExtents[i].first;
+                freeSwapExtents[i].first += cells;
+                freeSwapExtents[i].second -= cells;
+                if (freeSwapExtents[i].second == 0)
+                    freeSwapExtents.erase(freeSwapExtents.begin() + i);
+                return offset;
+            }
+        }
+        long long offset = swapFileCells;
+        swapFileCells += cells;
+        swapStats.peakSwapCells = max(swapStats.peakSwapCells, swapFileCells);
+        return offset;
+    }
+
+    int swapTransferCycles(int cells)
+    {
+        int rate = max(1, simOptions.swapRate);
+        return simOptions.swapLatency + (cells + rate - 1) / rate;
+    }
+
+    void countResidentProcesses(const vector<Process> &processes)
+    {
+        int resident = 0;
+        for (const Process &proc : processes)
+        {
+            if (!proc.segmentedBlocks.empty())
+                resident++;
+        }
+        swapStats.peakResident = max(swapStats.peakResident, resident);
+    }
+
+    // The I/O-blocked process to swap next: resident, not mapping shared code,
+    // waiting at least swapAfter cycles, and due back last. Requests still queued
+    // for a slot count as due back after everything in service.
+    IORequest *pickSwapVictim(IOSubsystem &io, vector<Process> &processes, int now, Process *&victim)
+    {
+        IORequest *best = nullptr;
+        long long bestDue = 0;
+        victim = nullptr;
+        for (IODevice &dev : io.devices)
+        {
+            for (int list = 0; list < 2; list++)
+            {
+                vector<IORequest> &requests = list == 0 ? dev.inService : dev.pending;
+                for (IORequest &req : requests)
+                {
+                    if (req.swappedOut || now - req.issueTime < simOptions.swapAfter)
+                        continue;
+                    long long due = list == 0 ? req.completionTime : LLONG_MAX - req.seq;
+                    if (best && due <= bestDue)
+                        continue;
+                    Process &proc = processes[req.processIndex];
+                    if (!proc.segmentedBlocks.empty() && !proc.sharesCode)
+                    {
+                        best = &req;
+                        bestDue = due;
+                        victim = &proc;
+                    }
+                }
+            }
+        }
+        return best;
+    }
+
+    void swapOutProcess(Process &proc, MemBlock *&segmentedMemory, int &totalCpuCycles)
+    {
+        int cells = 0;
+        for (MemBlock *seg : proc.segmentedBlocks)
+            cells += (int)seg->content.size();
+        proc.swapCells = cells;
+        proc.swapOffset = allocateSwapSlot(cells);
+        swapStream.seekp(proc.swapOffset * (long long)sizeof(int));
+        for (MemBlock *seg : proc.segmentedBlocks)
+            swapStream.write(reinterpret_cast<const char *>(seg->content.data()), seg->content.size() * sizeof(int));
+        swapStream.flush();
+
+        releaseProcessSegments(proc, segmentedMemory);
+        proc.swappedOut = true;
+
+        int cycles = swapTransferCycles(cells);
+        updateClock(totalCpuCycles, cycles, "swap out");
+        swapStats.swapOuts++;
+        swapStats.cellsOut += cells;
+        swapStats.cycles += cycles;
+        swapStats.swappedNow++;
+        swapStats.peakSwapped = max(swapStats.peakSwapped, swapStats.swappedNow);
+        out << "Process " << proc.processID << " swapped out (" << cells << " cells) while waiting for I/O." << endl;
+        noteEvent(EVENT_SWAPPED_OUT, proc.processID, totalCpuCycles);
+    }
+
+    // Read a swapped image back into new segments. The segment count may differ
+    // from before, so the table is rebuilt and everything after it (PCB, code,
+    // data) is copied across at its new offset. Returns false if memory is short.
+    bool swapInProcess(Process &proc, MemBlock *&segmentedMemory, int &totalCpuCycles)
+    {
+        int allocError = ALLOC_ERROR_NONE;
+        vector<MemBlock *> segments = allocateProcessSegments(segmentedMemory, proc, allocError, false);
+        if (segments.empty())
+            return false;
+
+        vector<int> image(proc.swapCells);
+        swapStream.seekg(proc.swapOffset * (long long)sizeof(int));
+        swapStream.read(reinterpret_cast<char *>(image.data()), image.size() * sizeof(int));
+        freeSwapExtents.push_back({proc.swapOffset, proc.swapCells});
+
+        int total = 0;
+        for (MemBlock *seg : segments)
+            total += seg->size;
+        vector<int> rebuilt(total, -1);
+        int numSegments = (int)segments.size();
+        rebuilt[0] = 2 * numSegments;
+        for (int i = 0; i < numSegments; i++)
+        {
+            rebuilt[1 + 2 * i] = segments[i]->start;
+            rebuilt[2 + 2 * i] = segments[i]->size;
+        }
+        int oldBody = image[0] + 1;
+        int newBody = rebuilt[0] + 1;
+        int bodyCells = min(proc.swapCells - oldBody, total - newBody);
+        copyCells(rebuilt.data() + newBody, image.data() + oldBody, bodyCells);
+        rebuilt[newBody + PCBLayout::MAIN_MEMORY_BASE] = segments[0]->start;
+
+        int index = 0;
+        for (MemBlock *seg : segments)
+        {
+            seg->content.assign(rebuilt.begin() + index, rebuilt.begin() + index + seg->size);
+            seg->dirtyMask.clear();
+            seg->dirtyLo = 0;
+            seg->dirtyHi = -1;
+            copyCells(&physicalMemory[seg->start], seg->content.data(), seg->size);
+            index += seg->size;
+        }
+        proc.segmentedBlocks = segments;
+        proc.swappedOut = false;
+
+        int cycles = swapTransferCycles(proc.swapCells);
+        updateClock(totalCpuCycles, cycles, "swap in");
+        swapStats.swapIns++;
+        swapStats.cellsIn += proc.swapCells;
+        swapStats.cycles += cycles;
+        swapStats.swappedNow--;
+        out << "Process " << proc.processID << " swapped in with segment table stored at physical address "
+             << segments[0]->start << " and is moved to the ReadyQueue." << endl;
+        noteEvent(EVENT_SWAPPED_IN, proc.processID, totalCpuCycles);
+        printAllocatedSegments(segments, proc.processID);
+        return true;
+    }
+
+    // Bring back processes whose I/O is done, oldest first, while memory allows.
+    void swapInReadyProcesses(IOSubsystem &io, queue<MemBlock *> &readyQueue, vector<Process> &processes,
+                              MemBlock *&segmentedMemory, int &totalCpuCycles)
+    {
+        while (!io.swapInQueue.empty())
+        {
+            MemBlock *block = io.swapInQueue.front().first;
+            Process &proc = processes[io.swapInQueue.front().second];
+            if (!swapInProcess(proc, segmentedMemory, totalCpuCycles))
+                break;
+            io.swapInQueue.pop();
+            readyQueue.push(block);
+        }
+    }
+
+    // The head of the NewJobQueue is stuck: swap out long-blocked processes one
+    // at a time until it loads or no candidate is left. Swapped processes that
+    // are ready to come back take precedence over new jobs.
+    void relieveMemoryPressure(IOSubsystem &io, deque<int> &newJobQueue, vector<Process> &processes,
+                               MemBlock *&logicalList, MemBlock *&segmentedMemory,
+                               queue<MemBlock *> &readyQueue, int &totalCpuCycles)
+    {
+        while (!newJobQueue.empty() && io.swapInQueue.empty())
+        {
+            Process *victim = nullptr;
+            IORequest *req = pickSwapVictim(io, processes, totalCpuCycles, victim);
+            if (!req)
+                break;
+            swapOutProcess(*victim, segmentedMemory, totalCpuCycles);
+            req->swappedOut = true;
+            loadWaitingJobs(newJobQueue, processes, logicalList, segmentedMemory, readyQueue, totalCpuCycles);
+        }
+        countResidentProcesses(processes);
+    }
+
+    void printSwapReport()
+    {
+        out << "----- Swap Report -----" << endl;
+        out << "Swap-outs: " << swapStats.swapOuts << " (" << swapStats.cellsOut << " cells)" << endl;
+        out << "Swap-ins: " << swapStats.swapIns << " (" << swapStats.cellsIn << " cells)" << endl;
+        out << "Cycles charged for swap traffic: " << swapStats.cycles << endl;
+        out << "Peak processes swapped out: " << swapStats.peakSwapped << endl;
+        out << "Peak swap file size: " << swapStats.peakSwapCells << " cells" << endl;
+        out << "Peak processes resident in memory: " << swapStats.peakResident << endl;
+        out << "-----------------------" << endl;
+    }
+
+    // -------------------------------------------------------------------------
+    // Memory Snapshots
+    // -------------------------------------------------------------------------
+    // With --snapshot-every=N the scheduler records physicalMemory into a
+    // keyframe + delta file (see Snapshot.h) at the first opportunity at or after
+    // every N cycles, and once more at the end. SnapshotTool rebuilds and prints
+    // the memory as of any cycle.
+
+    snapshot::Writer snapshotWriter;
+    long long nextSnapshotCycle = 0;
+
+    bool openSnapshots()
+    {
+        return snapshotWriter.open(simOptions.snapshotFile, (int)physicalMemory.size(), simOptions.keyframeEvery);
+    }
+
+    void takeSnapshotIfDue(int totalCpuCycles, bool force)
+    {
+        if (!snapshotWriter.isOpen() || (!force && totalCpuCycles < nextSnapshotCycle))
+            return;
+        snapshotWriter.write(totalCpuCycles, physicalMemory.data());
+        long long every = simOptions.snapshotEvery;
+        nextSnapshotCycle = (totalCpuCycles / every + 1) * every;
+    }
+
+    void closeSnapshots()
+    {
+        if (!snapshotWriter.isOpen())
+            return;
+        out << "Memory snapshots: " << snapshotWriter.recordCount() << " written to " << simOptions.snapshotFile
+             << " (" << snapshotWriter.byteCount() << " bytes)" << endl;
+        snapshotWriter.close();
+    }
+
+    // -------------------------------------------------------------------------
+    // Control Socket
+    // -------------------------------------------------------------------------
+    // With --control-socket=PATH a server thread listens on a Unix domain socket
+    // for newline-terminated commands:
+    //   JOB <record>     submit one process record (input file format, no @arrival)
+    //   LEN <bytes>      the next <bytes> bytes hold any number of records
+    //   STATS            one line of name=value pairs describing the live run
+    //   DONE             allow the run to finish once its work is done
+    //   QUIT             close this connection
+    // The server holds a job submission producer open, so the run does not end
+    // until a client sends DONE. STATS is answered from a seqlock-protected set
+    // of counters the scheduler publishes once per loop iteration; publishing
+    // never waits for a reader.
+
+    enum LiveStat
+    {
+        STAT_CLOCK,
+        STAT_BUSY_CYCLES,
+        STAT_READY,
+        STAT_NEW_JOBS,
+        STAT_IO_WAITING,
+        STAT_SWAP_IN,
+        STAT_ARRIVALS,
+        STAT_JOBS,
+        STAT_FINISHED,
+        STAT_MEMORY_CELLS,
+        STAT_FREE_CELLS,
+        STAT_LARGEST_FREE,
+        STAT_FREE_BLOCKS,
+        STAT_COUNT
+    };
+
+    const char *LIVE_STAT_NAMES[STAT_COUNT] = {"clock", "busy", "ready", "new", "io", "swapin", "arrivals",
+                                               "jobs", "finished", "memory", "free", "largest_free", "free_blocks"};
+
+    class LiveStatsBoard
+    {
+    public:
+        LiveStatsBoard() : sequence(0)
+        {
+            for (int i = 0; i < STAT_COUNT; i++)
+                values[i].store(0, memory_order_relaxed);
+        }
+
+        // Scheduler thread only.
+        void publish(const long long (&snapshot)[STAT_COUNT])
+        {
+            unsigned s = sequence.load(memory_order_relaxed);
+            sequence.store(s + 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
+            for (int i = 0; i < STAT_COUNT; i++)
+                values[i].store(snapshot[i], memory_order_relaxed);
+            sequence.store(s + 2, memory_order_release);
+        }
+
+        // Any thread. Retries while a publish is in progress.
+        void read(long long (&snapshot)[STAT_COUNT]) const
+        {
+            while (true)
+            {
+                unsigned before = sequence.load(memory_order_acquire);
+                if (before & 1)
+                {
+                    this_thread::yield();
+                    continue;
+                }
+                for (int i = 0; i < STAT_COUNT; i++)
+                    snapshot[i] = values[i].load(memory_order_relaxed);
+                atomic_thread_fence(memory_order_acquire);
+                if (sequence.load(memory_order_relaxed) == before)
+                    return;
+            }
+        }
+
+    private:
+        atomic<unsigned> sequence;
+        atomic<long long> values[STAT_COUNT];
+    };
+
+    LiveStatsBoard liveStats;
+    atomic<bool> controlStopping{false};
+    atomic<bool> controlHoldReleased{false};
+    thread controlThread;
+    int controlListenFd = -1;
+
+    bool controlServerRunning()
+    {
+        return controlListenFd >= 0;
+    }
+
+    void publishLiveStats(long long clock, long long busyCycles, size_t ready, size_t newJobs, size_t ioWaiting,
+                          size_t swapIn, size_t arrivals, size_t jobs, long long finished, MemBlock *segmentedMemory)
+    {
+        long long snapshot[STAT_COUNT] = {clock, busyCycles, (long long)ready, (long long)newJobs, (long long)ioWaiting,
+                                          (long long)swapIn, (long long)arrivals, (long long)jobs, finished,
+                                          (long long)physicalMemory.size(), 0, 0, 0};
+        for (MemBlock *b = segmentedMemory; b; b = b->next)
+        {
+            snapshot[STAT_FREE_CELLS] += b->size;
+            snapshot[STAT_LARGEST_FREE] = max(snapshot[STAT_LARGEST_FREE], (long long)b->size);
+            snapshot[STAT_FREE_BLOCKS]++;
+        }
+        liveStats.publish(snapshot);
+    }
+
+    string formatLiveStats()
+    {
+        long long snapshot[STAT_COUNT];
+        liveStats.read(snapshot);
+        stringstream out;
+        for (int i = 0; i < STAT_COUNT; i++)
+            out << (i ? " " : "") << LIVE_STAT_NAMES[i] << "=" << snapshot[i];
+        long long freeCells = snapshot[STAT_FREE_CELLS];
+        out << " utilisation=" << (snapshot[STAT_CLOCK] > 0 ? (double)snapshot[STAT_BUSY_CYCLES] / snapshot[STAT_CLOCK] : 0)
+            << " fragmentation=" << (freeCells > 0 ? 1.0 - (double)snapshot[STAT_LARGEST_FREE] / freeCells : 0);
+        return out.str();
+    }
+
+    // Submit every record in 'text'. All of them are read first, so nothing
+    // is submitted if one is malformed or there are more than maxRecords.
+    // Returns the number submitted, or -1.
+    int submitJobRecords(const string &text, int maxRecords)
+    {
+        istringstream in(text);
+        vector<Process> jobs;
+        while (in >> ws, !in.eof())
+        {
+            Process job;
+            bool hasArrival;
+            if ((int)jobs.size() == maxRecords || !readProcessRecord(in, job, hasArrival))
+                return -1;
+            job.arrivalTime = 0;
+            jobs.push_back(std::move(job));
+        }
+        for (Process &job : jobs)
+            submitJob(std::move(job));
+        return (int)jobs.size();
+    }
+
+    void releaseControlHold()
+    {
+        if (!controlHoldReleased.exchange(true))
+            closeJobSubmission();
+    }
+
+#ifdef OSSIM_CONTROL_SOCKET
+    struct ControlClient
+    {
+        int fd;
+        string input;
+        long long frameBytes; // bytes still owed to a LEN frame, or -1
+    };
+
+    void sendControlReply(int fd, const string &reply)
+    {
+        string line = reply + "\n";
+        size_t sent = 0;
+        while (sent < line.size())
+        {
+            ssize_t n = send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                return;
+            sent += (size_t)n;
+        }
+    }
+
+    // Handle every complete command in client.input. Returns false to close.
+    bool serveControlClient(ControlClient &client)
+    {
+        while (true)
+        {
+            if (client.frameBytes >= 0)
+            {
+                if ((long long)client.input.size() < client.frameBytes)
+                    return true;
+                int submitted = submitJobRecords(client.input.substr(0, (size_t)client.frameBytes), INT_MAX);
+                client.input.erase(0, (size_t)client.frameBytes);
+                client.frameBytes = -1;
+                sendControlReply(client.fd, submitted < 0 ? "ERR bad job record" : "OK " + to_string(submitted));
+                continue;
+            }
+            size_t newline = client.input.find('\n');
+            if (newline == string::npos)
+                return true;
+            string line = client.input.substr(0, newline);
+            client.input.erase(0, newline + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+
+            string command = line.substr(0, line.find(' '));
+            string rest = command.size() < line.size() ? line.substr(command.size() + 1) : "";
+            if (command == "JOB")
+            {
+                int submitted = submitJobRecords(rest, 1);
+                sendControlReply(client.fd, submitted == 1 ? "OK 1" : "ERR bad job record");
+            }
+            else if (command == "LEN" && atoll(rest.c_str()) >= 0 && !rest.empty())
+                client.frameBytes = atoll(rest.c_str());
+            else if (command == "STATS")
+                sendControlReply(client.fd, formatLiveStats());
+            else if (command == "DONE")
+            {
+                releaseControlHold();
+                sendControlReply(client.fd, "OK");
+            }
+            else if (command == "QUIT")
+                return false;
+            else if (!command.empty())
+                sendControlReply(client.fd, "ERR unknown command");
+        }
+    }
+
+    void runControlServer()
+    {
+        vector<ControlClient> clients;
+        while (!controlStopping.load(memory_order_acquire))
+        {
+            vector<pollfd> fds(1 + clients.size());
+            fds[0].fd = controlListenFd;
+            fds[0].events = POLLIN;
+            for (size_t i = 0; i < clients.size(); i++)
+            {
+                fds[i + 1].fd = clients[i].fd;
+                fds[i + 1].events = POLLIN;
+            }
+            if (poll(fds.data(), fds.size(), 100) <= 0)
+                continue;
+
+            for (size_t i = clients.size(); i-- > 0;)
+            {
+                if (!fds[i + 1].revents)
+                    continue;
+                char buf[4096];
+                ssize_t n = recv(clients[i].fd, buf, sizeof(buf), 0);
+                bool keep = n > 0;
+                if (keep)
+                {
+                    clients[i].input.append(buf, (size_t)n);
+                    keep = serveControlClient(clients[i]);
+                }
+                if (!keep)
+                {
+                    close(clients[i].fd);
+                    clients.erase(clients.begin() + i);
+                }
+            }
+            if (fds[0].revents & POLLIN)
+            {
+                int fd = accept(controlListenFd, nullptr, nullptr);
+                if (fd >= 0)
+                    clients.push_back({fd, string(), -1});
+            }
+        }
+        for (ControlClient &client : clients)
+            close(client.fd);
+    }
+
+    bool startControlServer(const string &path)
+    {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path))
+            return false;
+        strcpy(addr.sun_path, path.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+        // Only a stale socket is replaced; any other file at the path is left
+        // alone and the server does not start.
+        struct stat existing;
+        if (lstat(path.c_str(), &existing) == 0)
+        {
+            if (!S_ISSOCK(existing.st_mode))
+            {
+                close(fd);
+                return false;
+            }
+            unlink(path.c_str());
+        }
+        if (bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0)
+        {
+            close(fd);
+            return false;
+        }
+        controlListenFd = fd;
+        openJobSubmission();
+        controlThread = thread(&Impl::runControlServer, this);
+        return true;
+    }
+
+    void stopControlServer()
+    {
+        if (!controlServerRunning())
+            return;
+        controlStopping.store(true, memory_order_release);
+        controlThread.join();
+        close(controlListenFd);
+        controlListenFd = -1;
+        unlink(simOptions.controlSocket.c_str());
+        releaseControlHold();
+    }
+#else
+    bool startControlServer(const string &)
+    {
+        return false;
+    }
+
+    void stopControlServer()
+    {
+    }
+#endif
+
+    // -------------------------------------------------------------------------
+    // Adaptive Quantum
+    // -------------------------------------------------------------------------
+    // With --adaptive-quantum the time slice is no longer the header's fixed
+    // globalCPUAllocated. A CPU burst is the CPU time a process uses between I/O
+    // instructions (or until it terminates), summed over however many slices it
+    // takes. After every completed burst the quantum becomes the 80th percentile
+    // of the last QUANTUM_HISTORY bursts, so most bursts finish without being
+    // preempted, but never less than QUANTUM_SWITCH_FACTOR context switches, so
+    // switching stays a bounded share of the CPU, and always within
+    // [quantumMin, quantumMax].
+
+    static const int QUANTUM_HISTORY = 64;
+    static const int QUANTUM_SWITCH_FACTOR = 4;
+
+    struct QuantumController
+    {
+        int quantum = 0;
+        int initialQuantum = 0;
+        int floorQuantum = 0; // from the context switch time
+        vector<int> recentBursts;
+        int nextBurst = 0;
+        unordered_map<int, long long> openBursts; // CPU time of each process's unfinished burst
+        map<int, long long> dispatchesPerQuantum;
+        long long quantumSum = 0;
+        long long dispatches = 0;
+        long long preemptions = 0;
+        long long changes = 0;
+        vector<int> bursts; // every completed burst, for the report
+        long long burstsWithinQuantum = 0;
+    };
+
+    QuantumController quantumController;
+
+    int clampQuantum(int quantum)
+    {
+        return min(max(quantum, simOptions.quantumMin), simOptions.quantumMax);
+    }
+
+    void initQuantumController(int globalCPUAllocated, int contextSwitchTime)
+    {
+        QuantumController &qc = quantumController;
+        if (simOptions.quantumMax <= 0)
+            simOptions.quantumMax = max(simOptions.quantumMin, globalCPUAllocated * 4);
+        qc.initialQuantum = globalCPUAllocated;
+        qc.floorQuantum = QUANTUM_SWITCH_FACTOR * contextSwitchTime;
+        qc.quantum = clampQuantum(globalCPUAllocated);
+    }
+
+    // The slice for the next dispatch.
+    int dispatchQuantum()
+    {
+        QuantumController &qc = quantumController;
+        qc.dispatchesPerQuantum[qc.quantum]++;
+        qc.quantumSum += qc.quantum;
+        qc.dispatches++;
+        return qc.quantum;
+    }
+
+    // Account a finished slice of 'cycles' CPU time. 'burstEnded' is true when
+    // the slice ended in an I/O request or termination rather than a timeout.
+    void recordSlice(int processID, int cycles, bool burstEnded)
+    {
+        QuantumController &qc = quantumController;
+        long long &open = qc.openBursts[processID];
+        open += cycles;
+        if (!burstEnded)
+        {
+            qc.preemptions++;
+            return;
+        }
+        int burst = (int)min(open, (long long)INT_MAX);
+        qc.openBursts.erase(processID);
+        qc.bursts.push_back(burst);
+        if (burst <= qc.quantum)
+            qc.burstsWithinQuantum++;
+
+        if ((int)qc.recentBursts.size() < QUANTUM_HISTORY)
+            qc.recentBursts.push_back(burst);
+        else
+            qc.recentBursts[qc.nextBurst] = burst;
+        qc.nextBurst = (qc.nextBurst + 1) % QUANTUM_HISTORY;
+
+        vector<int> sorted = qc.recentBursts;
+        size_t k = (size_t)(0.8 * (sorted.size() - 1) + 0.5);
+        nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        int next = clampQuantum(max(sorted[k], qc.floorQuantum));
+        if (next != qc.quantum)
+            qc.changes++;
+        qc.quantum = next;
+    }
+
+    void printQuantumReport(const vector<Process> &processes, int totalCpuCycles, int contextSwitchTime)
+    {
+        const QuantumController &qc = quantumController;
+        vector<int> bursts = qc.bursts;
+        sort(bursts.begin(), bursts.end());
+        auto percentile = [&](double p) -> int
+        {
+            return bursts.empty() ? 0 : bursts[(size_t)(p * (bursts.size() - 1) + 0.5)];
+        };
+        double burstSum = 0;
+        for (int b : bursts)
+            burstSum += b;
+        double responseSum = 0, turnaroundSum = 0;
+        int completed = 0;
+        for (const Process &proc : processes)
+        {
+            if (proc.finishTime < 0)
+                continue;
+            responseSum += proc.startTime - proc.arrivalTime;
+            turnaroundSum += proc.finishTime - proc.arrivalTime;
+            completed++;
+        }
+        long long switchCycles = qc.dispatches * (long long)contextSwitchTime;
+
+        out << "----- Adaptive Quantum Report -----" << endl;
+        out << "Bounds: [" << simOptions.quantumMin << ", " << simOptions.quantumMax << "], switch floor "
+             << qc.floorQuantum << endl;
+        out << "Quantum: initial " << qc.initialQuantum << ", final " << qc.quantum
+             << ", mean per dispatch " << (qc.dispatches ? (double)qc.quantumSum / qc.dispatches : 0.0)
+             << ", changes " << qc.changes << endl;
+        out << "Dispatches per quantum:";
+        for (const auto &entry : qc.dispatchesPerQuantum)
+            out << " " << entry.first << "=" << entry.second;
+        out << endl;
+        out << "CPU bursts: " << bursts.size()
+             << ", mean " << (bursts.empty() ? 0.0 : burstSum / bursts.size())
+             << ", p50 " << percentile(0.5) << ", p80 " << percentile(0.8) << ", max " << percentile(1.0) << endl;
+        out << "Bursts finished within one quantum: "
+             << (bursts.empty() ? 0.0 : 100.0 * qc.burstsWithinQuantum / bursts.size()) << "%" << endl;
+        out << "Dispatches: " << qc.dispatches << ", preemptions " << qc.preemptions << endl;
+        out << "Context switch overhead: " << switchCycles << " cycles ("
+             << (totalCpuCycles > 0 ? 100.0 * switchCycles / totalCpuCycles : 0.0) << "% of the run)" << endl;
+        out << "Mean response: " << (completed ? responseSum / completed : 0.0)
+             << ", mean turnaround: " << (completed ? turnaroundSum / completed : 0.0) << endl;
+        out << "-----------------------------------" << endl;
+    }
+
+    // -------------------------------------------------------------------------
+    // Scheduler
+    // -------------------------------------------------------------------------
+
+    // Copy the cells each segment has written since the last sync into
+    // physicalMemory. Work is proportional to the number of dirty cells (plus
+    // the mask words between the first and last dirty word), not segment size.
+    void updatePhysicalMemoryForSegments(const vector<MemBlock *> &segments)
+    {
+        for (size_t s = 0; s < segments.size(); s++)
+        {
+            MemBlock *seg = segments[s];
+            if (seg->dirtyHi < seg->dirtyLo)
+                continue;
+            int *dst = &physicalMemory[seg->start];
+            const int *src = seg->content.data();
+            for (int w = seg->dirtyLo; w <= seg->dirtyHi; w++)
+            {
+                uint64_t bits = seg->dirtyMask[w];
+                seg->dirtyMask[w] = 0;
+                while (bits)
+                {
+                    // Copy each run of consecutive dirty cells in one go.
+                    int first = 0;
+                    while (!((bits >> first) & 1))
+                        first++;
+                    int last = first;
+                    while (last < 63 && ((bits >> (last + 1)) & 1))
+                        last++;
+                    int base = (w << 6) + first;
+                    copyCells(dst + base, src + base, last - first + 1);
+                    if (last == 63)
+                        bits = 0;
+                    else
+                        bits &= ~((((uint64_t)1 << (last + 1)) - 1));
+                }
+            }
+            seg->dirtyLo = 0;
+            seg->dirtyHi = -1;
+        }
+    }
+
+    // Move every job whose arrival time has passed into the NewJobQueue.
+    // Returns true if at least one job arrived.
+    bool admitArrivals(ArrivalQueue &arrivalQueue, deque<int> &newJobQueue, int totalCpuCycles)
+    {
+        bool arrived = false;
+        while (!arrivalQueue.empty() && arrivalQueue.top().first <= totalCpuCycles)
+        {
+            newJobQueue.push_back(arrivalQueue.top().second);
+            jobs[arrivalQueue.top().second].forwardAccessMark = sampling.forwardAccesses;
+            noteEvent(EVENT_ARRIVED, jobs[arrivalQueue.top().second].processID, arrivalQueue.top().first);
+            arrivalQueue.pop();
+            arrived = true;
+        }
+        return arrived;
+    }
+
+    // Turnaround is measured from arrival, response from arrival to first dispatch.
+    void printLatencyReport(const vector<QueuedJob> &jobs, const vector<Process> &processes, int totalCpuCycles)
+    {
+        vector<int> turnaround;
+        vector<int> response;
+        int firstArrival = -1, lastArrival = 0;
+        for (const QueuedJob &job : jobs)
+        {
+            if (firstArrival < 0 || job.arrivalTime < firstArrival)
+                firstArrival = job.arrivalTime;
+            lastArrival = max(lastArrival, job.arrivalTime);
+        }
+        for (const Process &proc : processes)
+        {
+            if (proc.finishTime < 0)
+                continue;
+            turnaround.push_back(proc.finishTime - proc.arrivalTime);
+            response.push_back(proc.startTime - proc.arrivalTime);
+        }
+        if (firstArrival < 0)
+            firstArrival = 0;
+
+        auto percentile = [](vector<int> &v, double p) -> int
+        {
+            if (v.empty())
+                return 0;
+            size_t k = (size_t)(p * (v.size() - 1) + 0.5);
+            nth_element(v.begin(), v.begin() + k, v.end());
+            return v[k];
+        };
+        auto mean = [](const vector<int> &v) -> double
+        {
+            double sum = 0;
+            for (int x : v)
+                sum += x;
+            return v.empty() ? 0.0 : sum / v.size();
+        };
+
+        int arrivalSpan = lastArrival - firstArrival;
+        out << "----- Latency Report -----" << endl;
+        out << "Jobs completed: " << turnaround.size() << " of " << jobs.size() << endl;
+        if (arrivalSpan > 0)
+            out << "Offered load: " << (1000.0 * (jobs.size() - 1) / arrivalSpan) << " jobs per 1000 cycles" << endl;
+        if (totalCpuCycles > 0)
+            out << "Throughput: " << (1000.0 * turnaround.size() / totalCpuCycles) << " jobs per 1000 cycles" << endl;
+        out << "Turnaround: mean " << mean(turnaround)
+             << ", p50 " << percentile(turnaround, 0.50)
+             << ", p95 " << percentile(turnaround, 0.95)
+             << ", p99 " << percentile(turnaround, 0.99)
+             << ", max " << percentile(turnaround, 1.0) << endl;
+        out << "Response: mean " << mean(response)
+             << ", p50 " << percentile(response, 0.50)
+             << ", p99 " << percentile(response, 0.99)
+             << ", max " << percentile(response, 1.0) << endl;
+        out << "--------------------------" << endl;
+    }
+
+    // Run state. The workload fills in the header and jobs; startRun sets
+    // up the rest and stepRun advances it by one scheduler iteration.
+    static const int MAX_IDLE_ITERATIONS = 1000; // maximum iterations to wait while idle
+
+    bool workloadStarted = false;
+    int maxMemory = 0;
+    int globalCPUAllocated = 0;
+    int contextSwitchTime = 0;
+    vector<Process> processes; // admitted jobs, in admission order
+    queue<MemBlock *> readyQueue;
+    IOSubsystem ioQueue;
+    deque<int> newJobQueue; // a deque so pre-staging can look ahead
+    ArrivalQueue arrivalQueue;
+    MemBlock *logicalList = nullptr;     // contiguous pool for execution
+    MemBlock *segmentedMemory = nullptr; // segmented allocation pool
+    vector<thread> producers;
+    int totalCpuCycles = 0;
+    int idleIterationCount = 0;
+    MemBlock *runningBlock = nullptr;
+    bool firstProcessPicked = false;
+    long long busyCycles = 0;
+    long long finishedJobs = 0;
+    bool runStarted = false;
+    bool runFinished = false;
+
+    bool failRun(const string &message)
+    {
+        out << "Error: " << message << endl;
+        result.error = message;
+        outputCapture.detach(false);
+        runFinished = true;
+        return false;
+    }
+
+    // Set up memory, the queues and the helper threads, admit the first jobs
+    // and print the initial memory dump. Returns false if there is nothing to
+    // step: the run could not start or was replayed from the result cache.
+    bool startRun()
+    {
+        runStarted = true;
+        beginWorkload();
+        if (cachingResult && replayCachedResult())
+        {
+            runFinished = true;
+            return false;
+        }
+
+        // Initialize fakeMemory to size maxMemory with -1
+        physicalMemory.resize(maxMemory, -1);
+
+        logicalList = initDynamicMemory(maxMemory + 10000000);
+        initMemoryBanks(maxMemory);
+        initCaches();
+        segmentedMemory = initBankedMemory(maxMemory);
+
+        // Jobs enter the NewJobQueue from the arrival queue as the clock passes
+        // their arrival time; without arrival times they all arrive at cycle 0.
+        for (int i = 0; i < (int)jobs.size(); i++)
+        {
+            arrivalQueue.push({jobs[i].arrivalTime, i});
+        }
+
+        initIOSubsystem(ioQueue);
+        if (simOptions.snapshotEvery > 0 && !openSnapshots())
+            return failRun("cannot open snapshot file " + simOptions.snapshotFile);
+        if (simOptions.swapping && !openSwapFile())
+            return failRun("cannot open swap file " + simOptions.swapFile);
+        if (!simOptions.controlSocket.empty() && !startControlServer(simOptions.controlSocket))
+            return failRun("cannot open control socket " + simOptions.controlSocket);
+        loaderPool.start(simOptions.loaderThreads);
+        if (simOptions.prestageDepth > 0)
+            jobStager.start();
+        producers = startProducers(maxMemory);
+
+        if (simOptions.adaptiveQuantum)
+            initQuantumController(globalCPUAllocated, contextSwitchTime);
+
+        // Load waiting processes.
+        admitArrivals(arrivalQueue, newJobQueue, totalCpuCycles);
+        loadWaitingJobs(newJobQueue, processes, logicalList, segmentedMemory, readyQueue, totalCpuCycles);
+
+        {
+            ScopedTimer timer(hostTimer(HOST_DUMP));
+            for (int i = 0; i < (int)physicalMemory.size(); i++)
+            {
+                out << i << " : " << physicalMemory[i] << "\n";
+            }
+        }
+        takeSnapshotIfDue(totalCpuCycles, true);
+        return true;
+    }
+
+    // One iteration of the main scheduling loop. Returns false once the run
+    // is over.
+    bool stepRun()
+    {
+        if (readyQueue.empty() && ioQueue.empty() && newJobQueue.empty() && arrivalQueue.empty() &&
+            ioQueue.swapInQueue.empty() && !jobSubmission.pending())
+        {
+            finishRun(false);
+            return false;
+        }
+
+        // Jobs that arrived while the last process ran are admitted right away,
+        // as are jobs submitted through the API since the last look.
+        if (admitArrivals(arrivalQueue, newJobQueue, totalCpuCycles) || jobSubmission.hasWork())
+        {
+            loadWaitingJobs(newJobQueue, processes, logicalList, segmentedMemory, readyQueue, totalCpuCycles);
+        }
+        takeSnapshotIfDue(totalCpuCycles, false);
+        if (simOptions.swapping)
+        {
+            swapInReadyProcesses(ioQueue, readyQueue, processes, segmentedMemory, totalCpuCycles);
+            relieveMemoryPressure(ioQueue, newJobQueue, processes, logicalList, segmentedMemory,
+                                  readyQueue, totalCpuCycles);
+        }
+        if (controlServerRunning())
+            publishLiveStats(totalCpuCycles, busyCycles, readyQueue.size(), newJobQueue.size(), ioQueue.size(),
+                             ioQueue.swapInQueue.size(), arrivalQueue.size(), jobs.size(), finishedJobs,
+                             segmentedMemory);
+
+        // Nothing in the system yet: jump the clock to the next arrival, or
+        // wait for a producer to submit something.
+        if (readyQueue.empty() && ioQueue.empty() && newJobQueue.empty() && ioQueue.swapInQueue.empty())
+        {
+            if (!arrivalQueue.empty())
+                totalCpuCycles = max(totalCpuCycles, arrivalQueue.top().first);
+            else
+                this_thread::yield();
+            return true;
+        }
+
+        // Check if we're idle: no ready or I/O work, but jobs are waiting in NewJobQueue.
+        if (readyQueue.empty() && ioQueue.empty() && (!newJobQueue.empty() || !ioQueue.swapInQueue.empty()))
+        {
+            // Increment idle iteration count.
+            idleIterationCount++;
+            // Optionally, simulate time passing by incrementing totalCpuCycles even if idle.
+            totalCpuCycles++;
+            // If we exceed threshold, exit gracefully.
+            if (idleIterationCount >= MAX_IDLE_ITERATIONS)
+            {
+                out << "Error: A job has been stuck in the NewJobQueue for too long due to insufficient memory." << endl;
+                out << "Exiting gracefully." << endl;
+                finishRun(true);
+                return false;
+            }
+            return true; // Skip the rest of the loop, nothing to do this iteration.
+        }
+        else
+        {
+            // Reset idle counter when we have activity.
+            idleIterationCount = 0;
+        }
+
+        checkIOQueueSimultaneously(ioQueue, readyQueue, totalCpuCycles);
+        if (simOptions.swapping)
+            swapInReadyProcesses(ioQueue, readyQueue, processes, segmentedMemory, totalCpuCycles);
+        if (!runningBlock)
+        {
+            if (readyQueue.empty() && !ioQueue.empty())
+            {
+                contextSwitch(totalCpuCycles, contextSwitchTime, "CPU idle with I/O waiting");
+                return true;
+            }
+            if (!readyQueue.empty())
+            {
+                runningBlock = readyQueue.front();
+                readyQueue.pop();
+                if (!firstProcessPicked)
+                {
+                    contextSwitch(totalCpuCycles, contextSwitchTime, "Initial context switch");
+                    firstProcessPicked = true;
+                }
+                else
+                {
+                    contextSwitch(totalCpuCycles, contextSwitchTime, "New process from ReadyQueue");
+                }
+                int procID = runningBlock->content[PCBLayout::ID];
+                int theStartTime = 0;
+                switchCacheContext(procID);
+                for (auto &proc : processes)
+                {
+                    if (proc.processID == procID)
+                    {
+                        if (proc.startTime == -1)
+                        {
+                            proc.startTime = totalCpuCycles;
+                        }
+                        theStartTime = proc.startTime;
+                        break;
+                    }
+                }
+
+                vector<MemBlock *> segBlocks;
+                Process *runningProc = nullptr;
+                int runningIndex = -1;
+                for (size_t i = 0; i < processes.size(); i++)
+                {
+                    if (processes[i].processID == procID)
+                    {
+                        segBlocks = processes[i].segmentedBlocks; // found the matching process
+                        runningProc = &processes[i];
+                        runningIndex = (int)i;
+                        break;
+                    }
+                }
+
+                int ioBurst = 0;
+                int sliceStart = totalCpuCycles;
+                int quantum = simOptions.adaptiveQuantum ? dispatchQuantum() : globalCPUAllocated;
+                bool finished = executeProcess(runningBlock, totalCpuCycles, quantum, theStartTime, segBlocks, ioBurst);
+                busyCycles += totalCpuCycles - sliceStart;
+                if (simOptions.adaptiveQuantum)
+                    recordSlice(procID, totalCpuCycles - sliceStart,
+                                finished || runningBlock->content[PCBLayout::STATE] == STATE_IO_WAITING);
+                if (runningProc)
+                {
+                    // A store into shared code gives the process a private copy.
+                    resolveCopyOnWrite(*runningProc, runningBlock, segmentedMemory);
+                    // Only the cells this time slice wrote are copied back.
+                    updatePhysicalMemoryForSegments(runningProc->segmentedBlocks);
+                }
+                if (!finished)
+                {
+                    if (runningBlock->content[PCBLayout::STATE] == STATE_IO_WAITING)
+                    {
+                        submitIORequest(ioQueue, runningBlock, runningIndex, ioBurst,
+                                        runningBlock->content[PCBLayout::CPU_CYCLES], totalCpuCycles);
+                    }
+                    else
+                    {
+                        readyQueue.push(runningBlock);
+                    }
+                }
+                else
+                {
+                    for (size_t i = 0; i < processes.size(); i++)
+                    {
+                        if (processes[i].processID == procID)
+                        {
+                            releaseProcessSegments(processes[i], segmentedMemory);
+                            break;
+                        }
+                    }
+                    for (auto &proc : processes)
+                    {
+                        if (proc.processID == procID)
+                        {
+                            proc.finishTime = totalCpuCycles;
+                            proc.exitProgramCounter = runningBlock->content[PCBLayout::PC];
+                            proc.exitRegister = runningBlock->content[PCBLayout::REGISTER];
+                            proc.exitCpuCycles = runningBlock->content[PCBLayout::CPU_CYCLES];
+                            sampling.lifetimeForwardAccesses += sampling.forwardAccesses - proc.forwardAccessMark;
+                            vector<int>().swap(proc.instructions); // not needed after exit
+                            break;
+                        }
+                    }
+                    out << "Process " << procID << " terminated and freed memory blocks." << endl;
+                    noteEvent(EVENT_TERMINATED, procID, totalCpuCycles);
+                    finishedJobs++;
+                    if (simOptions.profileMemory)
+                        finishMemoryProfile(procID);
+
+                    loadWaitingJobs(newJobQueue, processes, logicalList, segmentedMemory, readyQueue, totalCpuCycles);
+                }
+                runningBlock = nullptr;
+            }
+        }
+        return true;
+    }
+
+    // Print the closing reports (unless the run was abandoned), fill in the
+    // result and stop the helper threads.
+    // Throughput, mean turnaround and utilisation, with confidence intervals
+    // when the run was sampled.
+    void summariseRun()
+    {
+        double turnaroundSum = 0;
+        for (const Process &proc : processes)
+        {
+            if (proc.finishTime >= 0)
+                turnaroundSum += proc.finishTime - proc.arrivalTime;
+        }
+        result.throughput = Estimate();
+        result.turnaround = Estimate();
+        result.utilisation = Estimate();
+        if (totalCpuCycles > 0)
+        {
+            result.throughput.value = 1000.0 * finishedJobs / totalCpuCycles;
+            result.utilisation.value = (double)busyCycles / totalCpuCycles;
+        }
+        if (finishedJobs > 0)
+            result.turnaround.value = turnaroundSum / finishedJobs;
+        if (simOptions.sampleDetailed > 0)
+            estimateSamplingError();
+    }
+
+    void finishRun(bool abandoned)
+    {
+        setSamplingQuiet(false);
+        if (!abandoned)
+        {
+            contextSwitch(totalCpuCycles, contextSwitchTime, "Final context switch");
+            out << "Total CPU time used: " << totalCpuCycles << ".\n";
+            takeSnapshotIfDue(totalCpuCycles, true);
+            summariseRun();
+
+            if (simOptions.latencyReport)
+                printLatencyReport(jobs, processes, totalCpuCycles);
+            if (!simOptions.ioDevices.empty())
+                printIOReport(ioQueue, totalCpuCycles);
+            if (simOptions.shareCode)
+                printSharingReport();
+            if (banksEnabled())
+                printBankReport();
+            if (cachesEnabled())
+                printCacheReport(jobs);
+            if (simOptions.swapping)
+                printSwapReport();
+            if (simOptions.profileMemory)
+                printMemoryProfileReport(jobs);
+            if (simOptions.adaptiveQuantum)
+                printQuantumReport(processes, totalCpuCycles, contextSwitchTime);
+            if (simOptions.prestageDepth > 0)
+                printPrestageReport();
+            if (simOptions.sampleDetailed > 0)
+                printSamplingReport();
+            closeSnapshots();
+
+            flushLogs();
+        }
+
+        for (thread &producer : producers)
+            producer.join();
+        loaderPool.stop();
+        jobStager.stop();
+        stopControlServer();
+        closeSwapFile();
+        if (simOptions.hostTimers && !writeHostTimers(simOptions.hostTimersFile))
+            out << "Error: cannot write host timers to " << simOptions.hostTimersFile << endl;
+
+        if (abandoned)
+            summariseRun();
+        result.abandoned = abandoned;
+        result.counters.totalCpuTime = totalCpuCycles;
+        result.counters.busyCycles = busyCycles;
+        result.counters.processes = (long long)jobs.size();
+        result.counters.finishedJobs = finishedJobs;
+        // Jobs still queued never got a Process; the queued instructions are
+        // not needed any more.
+        string().swap(jobArena);
+        result.processes.clear();
+        result.processes.reserve(jobs.size());
+        const Process neverAdmitted = Process();
+        for (const QueuedJob &job : jobs)
+        {
+            const Process &proc = job.processIndex >= 0 ? processes[job.processIndex] : neverAdmitted;
+            ProcessOutcome outcome;
+            outcome.processID = job.processID;
+            outcome.finished = proc.finishTime >= 0;
+            outcome.arrivalTime = job.arrivalTime;
+            outcome.startTime = proc.startTime;
+            outcome.finishTime = proc.finishTime;
+            outcome.maxMemoryNeeded = job.maxMemoryNeeded;
+            outcome.programCounter = proc.exitProgramCounter;
+            outcome.registerValue = proc.exitRegister;
+            outcome.cpuCyclesUsed = proc.exitCpuCycles;
+            result.processes.push_back(outcome);
+        }
+        if (cachingResult)
+            storeResult();
+        runFinished = true;
+    }
+
+    bool step()
+    {
+        if (runFinished)
+            return false;
+        if (!runStarted)
+            return startRun();
+        return stepRun();
+    }
+};
+
+// -----------------------------------------------------------------------------
+// Simulator
+// -----------------------------------------------------------------------------
+
+namespace
+{
+
+Process toProcess(const ProcessRecord &record, bool extendedOpcodes)
+{
+    Process proc;
+    proc.processID = record.processID;
+    proc.maxMemoryNeeded = record.maxMemoryNeeded;
+    proc.instructions = record.instructions;
+    proc.numInstructions = 0;
+    for (size_t i = 0; i < record.instructions.size(); i += 1 + opcodeArity(record.instructions[i], extendedOpcodes))
+        proc.numInstructions++;
+    if (record.arrivalTime >= 0)
+        proc.arrivalTime = record.arrivalTime;
+    return proc;
+}
+
+} // namespace
+
+Simulator::Simulator(const SimOptions &options, ostream *output) : impl(new Impl(options, output))
+{
+}
+
+Simulator::~Simulator()
+{
+}
+
+bool Simulator::loadWorkload(istream &in)
+{
+    return impl->parseProcesses(in);
+}
+
+void Simulator::setHeader(int maxMemory, int quantum, int contextSwitchTime)
+{
+    impl->setHeader(maxMemory, quantum, contextSwitchTime);
+}
+
+void Simulator::addProcess(const ProcessRecord &record)
+{
+    impl->addProcess(toProcess(record, impl->simOptions.extendedOpcodes), record.arrivalTime >= 0);
+}
+
+void Simulator::openJobSubmission()
+{
+    impl->openJobSubmission();
+}
+
+void Simulator::submitJob(const ProcessRecord &record)
+{
+    impl->submitJob(toProcess(record, impl->simOptions.extendedOpcodes));
+}
+
+void Simulator::closeJobSubmission()
+{
+    impl->closeJobSubmission();
+}
+
+bool Simulator::step()
+{
+    return impl->step();
+}
+
+const RunResult &Simulator::run()
+{
+    while (impl->step())
+    {
+    }
+    return impl->result;
+}
+
+const RunResult &Simulator::result() const
+{
+    return impl->result;
+}
+
+bool Simulator::benchmarkCore(int runs)
+{
+    return impl->runCoreBenchmark(runs) == 0;
+}
+
+bool Simulator::selfCheck()
+{
+    return impl->runCellSelfCheck() == 0;
+}
+
+} // namespace ossim
\ No newline at end of file
@@ -0,0 +1,316 @@
+#ifndef OSSIM_H
+#define OSSIM_H
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Simulator Library
+//
+// The simulator as a library. A Simulator owns all of its state, so any
+// number of them can live in one process; each one must only be driven from
+// one thread at a time. The text the command-line tool prints goes to the
+// stream given to the constructor (or nowhere), and the run is also returned
+// as a RunResult.
+//
+//   ossim::SimOptions options;
+//   options.placement = ossim::PLACE_BEST_FIT;
+//   ossim::Simulator sim(options);
+//   sim.loadWorkload(input);                   // header and process records
+//   const ossim::RunResult &result = sim.run(); // or step() until it returns false
+// -----------------------------------------------------------------------------
+
+namespace ossim
+{
+
+// Segment placement policies for allocateProcessSegments.
+enum PlacementPolicy
+{
+    PLACE_FIRST_FIT,
+    PLACE_BEST_FIT,
+    PLACE_WORST_FIT,
+    PLACE_NEXT_FIT
+};
+
+// I/O device service disciplines and service-time models.
+enum IODiscipline
+{
+    IO_FCFS,
+    IO_PRIORITY,
+    IO_SSTF
+};
+
+enum IOLatencyModel
+{
+    IO_LATENCY_FIXED,   // the print operand
+    IO_LATENCY_UNIFORM, // operand * (1 +/- jitter)
+    IO_LATENCY_EXP      // exponential with the operand as mean
+};
+
+struct IODeviceConfig
+{
+    std::string name = "io0";
+    IODiscipline discipline = IO_FCFS;
+    int concurrency = 0; // requests in service at once, 0 = unlimited
+    IOLatencyModel latency = IO_LATENCY_FIXED;
+    double scale = 1.0;    // multiplies the print operand
+    double jitter = 0.25;  // for IO_LATENCY_UNIFORM
+    int tracks = 1000;     // SSTF positions
+    double seekCost = 0.0; // cycles per track moved
+};
+
+// Cache levels for store/load timing, listed from the CPU outwards.
+enum CacheReplacement
+{
+    CACHE_LRU,
+    CACHE_PLRU // tree pseudo-LRU, needs a power-of-two associativity
+};
+
+struct CacheConfig
+{
+    std::string name = "L1";
+    int size = 256; // cells
+    int assoc = 4;
+    int line = 8;    // cells per line
+    int latency = 1; // cycles to probe this level
+    CacheReplacement policy = CACHE_LRU;
+};
+
+struct SimOptions
+{
+    // Print turnaround/response statistics after the run. Turned on
+    // automatically when the workload carries arrival times.
+    bool latencyReport = false;
+    // Scrub physical memory (and the freed segment's contents) when a
+    // segment is returned to the free list.
+    bool zeroOnFree = false;
+    // Where allocateProcessSegments places segments, and how many segments a
+    // process may be split into. The segment table reservation follows the cap.
+    PlacementPolicy placement = PLACE_FIRST_FIT;
+    int maxSegments = 6;
+    // I/O devices; empty means a single unlimited FCFS device.
+    std::vector<IODeviceConfig> ioDevices;
+    // Deduplicate identical programs and share their code segments.
+    bool shareCode = false;
+    // Run decoded programs with fused compute runs (see executeProcess);
+    // --no-fusion selects the reference instruction-at-a-time interpreter.
+    bool fuseInstructions = true;
+    // Run opcodes 5-10 (jumps, loops, memset, memcpy). Off by default, so a
+    // trace written for opcodes 1-4 runs as before even when its stores put
+    // 5-10 into code cells; those cells then take no operands and do nothing.
+    // jumpLimit ends a process after that many taken jumps and loops, so a
+    // program that never leaves a loop cannot hold the CPU (0 = no limit).
+    bool extendedOpcodes = false;
+    long long jumpLimit = 1000000;
+    // Physical memory banks (1 = one flat memory). Each bank adds its own
+    // latency to store/load; an access outside the process's home bank (the
+    // bank of its segment table) also pays remotePenalty. With bankLocal,
+    // allocation keeps a process in one bank when one has room.
+    int banks = 1;
+    std::vector<int> bankLatency; // extra cycles per bank; the last value repeats
+    int remotePenalty = 0;
+    bool bankLocal = true;
+    // Cache hierarchy in front of physical memory; empty means every store
+    // and load goes straight to memory. A miss in every level also pays
+    // memoryLatency. flushCacheOnSwitch empties the caches whenever a
+    // different process is dispatched.
+    std::vector<CacheConfig> caches;
+    int memoryLatency = 10;
+    bool flushCacheOnSwitch = false;
+    // Medium-term swapper: while a job is stuck in the NewJobQueue, processes
+    // blocked on I/O for at least swapAfter cycles have their segments written
+    // to swapFile and freed. A transfer costs swapLatency cycles plus one
+    // cycle per swapRate cells.
+    bool swapping = false;
+    std::string swapFile = "swap.bin";
+    int swapAfter = 10;
+    int swapLatency = 20;
+    int swapRate = 16;
+    // In-process load generators submitting through the job submission API,
+    // and how many submitted jobs loadWaitingJobs takes per call.
+    int producers = 0;
+    int jobsPerProducer = 100;
+    int submitBatch = 64;
+    // Binary physical memory snapshots every snapshotEvery cycles (0 = off),
+    // with a full keyframe every keyframeEvery snapshots.
+    int snapshotEvery = 0;
+    std::string snapshotFile = "memory.snap";
+    int keyframeEvery = 16;
+    // Time the execution core on a synthetic program this many times and exit.
+    int benchCore = 0;
+    // Check the bulk memory primitives against plain loops and exit.
+    bool selfCheck = false;
+    // Worker threads that build admitted images (0 = on the scheduler thread).
+    int loaderThreads = 0;
+    // Unix domain socket for live job submission and stats queries.
+    std::string controlSocket;
+    // Per-process store/load address profiling, with the working set taken
+    // over the last profileWindow accesses.
+    bool profileMemory = false;
+    int profileWindow = 32;
+    // Adapt the time slice to observed CPU bursts, within [quantumMin,
+    // quantumMax] (quantumMax 0 = four times the header's quantum).
+    bool adaptiveQuantum = false;
+    int quantumMin = 1;
+    int quantumMax = 0;
+    // Varint-encode the instructions of jobs waiting for admission.
+    bool compactQueue = true;
+    // Jobs at the front of the NewJobQueue a helper thread prepares for
+    // admission ahead of time (0 = off).
+    int prestageDepth = 0;
+    // Time subsystem entry points and write latency histograms as JSON.
+    bool hostTimers = false;
+    std::string hostTimersFile = "host_timers.json";
+    // On-disk result cache directory (empty = off), and the share of hits
+    // that are rerun and compared with the stored output.
+    std::string resultCache;
+    int verifyCachePercent = 0;
+    // Record a TimelineEvent for every process state change in RunResult.
+    bool recordTimeline = false;
+    // Sampled simulation (sampleDetailed 0 = off). Time slices run in
+    // periods of sampleWarmup + sampleDetailed + sampleForward; somewhere in
+    // each period sampleWarmup slices are simulated in detail but not
+    // measured, then sampleDetailed are simulated in detail and measured, and
+    // the rest are fast-forwarded. sampleValidate makes the command-line tool
+    // compare a sampled run with a full one.
+    int sampleDetailed = 0;
+    int sampleForward = 0;
+    int sampleWarmup = 1;
+    bool sampleValidate = false;
+};
+
+// One process record as it appears in the input file.
+struct ProcessRecord
+{
+    int arrivalTime = -1; // -1: no arrival time (arrives at cycle 0)
+    int processID = 0;
+    int maxMemoryNeeded = 0;
+    std::vector<int> instructions; // opcodes interleaved with their operands
+};
+
+// What became of one process.
+struct ProcessOutcome
+{
+    int processID = 0;
+    bool finished = false;
+    int arrivalTime = 0;
+    int startTime = -1; // first dispatch, -1 if it never ran
+    int finishTime = -1;
+    int maxMemoryNeeded = 0;
+    // The PCB when the process terminated.
+    int programCounter = 0;
+    int registerValue = 0;
+    int cpuCyclesUsed = 0;
+};
+
+enum TimelineEventKind
+{
+    EVENT_ARRIVED,     // entered the NewJobQueue
+    EVENT_LOADED,      // placed in memory and moved to the ReadyQueue
+    EVENT_DISPATCHED,  // started a time slice
+    EVENT_PREEMPTED,   // TimeOUT interrupt
+    EVENT_IO_WAIT,     // issued an I/O request
+    EVENT_IO_DONE,     // I/O completed
+    EVENT_SWAPPED_OUT, // image written to the swap file
+    EVENT_SWAPPED_IN,
+    EVENT_TERMINATED
+};
+
+struct TimelineEvent
+{
+    long long cycle;
+    int processID;
+    TimelineEventKind kind;
+};
+
+// A figure from the run. For a sampled run halfWidth is the half-width of
+// its 95% interval from the access cost uncertainty alone, which leaves out
+// the scheduling shifts of the sampled clock; otherwise it is 0.
+struct Estimate
+{
+    double value = 0;
+    double halfWidth = 0;
+};
+
+struct SamplingSummary
+{
+    long long warmupSlices = 0;
+    long long detailedSlices = 0; // measured
+    long long forwardSlices = 0;
+    long long measuredAccesses = 0;
+    long long forwardAccesses = 0;
+    Estimate accessCost; // cycles per memory access in measured slices, all processes
+};
+
+struct RunCounters
+{
+    long long totalCpuTime = 0; // the final clock ("Total CPU time used")
+    long long busyCycles = 0;   // cycles spent in time slices
+    long long contextSwitches = 0;
+    long long processes = 0;
+    long long finishedJobs = 0;
+};
+
+struct RunResult
+{
+    std::string error;      // set if the run could not start
+    bool abandoned = false; // a job never fit in memory and the run gave up
+    bool fromCache = false; // replayed from the result cache; only counters are filled in
+    bool cacheDrift = false; // a verified result cache entry differed and was replaced
+    std::vector<std::string> cacheNotes; // what the result cache did, one line each
+    RunCounters counters;
+    Estimate throughput;  // finished jobs per 1000 cycles
+    Estimate turnaround;  // mean over finished jobs, in cycles
+    Estimate utilisation; // busy cycles / total CPU time
+    bool sampled = false;
+    SamplingSummary sampling;
+    std::vector<ProcessOutcome> processes; // in input order, then submitted jobs
+    std::vector<TimelineEvent> timeline;   // with SimOptions::recordTimeline
+};
+
+class Simulator
+{
+public:
+    explicit Simulator(const SimOptions &options = SimOptions(), std::ostream *output = nullptr);
+    ~Simulator();
+
+    // Read the header and the process records in the input file format.
+    // Returns false if the input ends early.
+    bool loadWorkload(std::istream &in);
+    // Or describe the workload directly.
+    void setHeader(int maxMemory, int quantum, int contextSwitchTime);
+    void addProcess(const ProcessRecord &record);
+
+    // Jobs submitted while the run is going; any thread may call these. The
+    // run does not end while a submitter is open.
+    void openJobSubmission();
+    void submitJob(const ProcessRecord &record);
+    void closeJobSubmission();
+
+    // One scheduler iteration (the first call sets up memory and admits the
+    // first jobs). Returns false once the run is over and result() is final.
+    bool step();
+    const RunResult &run();
+    const RunResult &result() const;
+
+    // Time the execution core for each memory timing policy and opcode set
+    // on a synthetic program (--bench-core) and print the figures.
+    bool benchmarkCore(int runs);
+
+    // Check the SIMD bulk memory primitives against plain loops
+    // (--self-check) and print the results. Returns false on any mismatch.
+    bool selfCheck();
+
+private:
+    Simulator(const Simulator &) = delete;
+    Simulator &operator=(const Simulator &) = delete;
+
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // namespace ossim
+
+#endif
@@ -0,0 +1,306 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Physical Memory Snapshots
+//
+// Binary file of periodic physical memory snapshots:
+//   header:  "OSSNAP01" varint(cellCount)
+//   record:  type ('K' keyframe or 'D' delta) varint(cycle) varint(payloadBytes) payload
+// A keyframe payload is the whole memory as runs: varint(count) zigzag(value).
+// A delta payload covers the memory against the previous snapshot as
+// varint(unchanged) varint(changed) followed by the changed cells as runs,
+// repeated until every cell is accounted for. Every keyframeEvery-th record
+// is a keyframe so rebuilding any cycle replays a bounded number of deltas.
+// -----------------------------------------------------------------------------
+
+namespace snapshot
+{
+
+static const char MAGIC[8] = {'O', 'S', 'S', 'N', 'A', 'P', '0', '1'};
+const uint8_t RECORD_KEYFRAME = 'K';
+const uint8_t RECORD_DELTA = 'D';
+
+inline void putVarint(std::string &out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+inline bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v)
+{
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *p++;
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Small negative values (-1 for empty cells) stay one byte.
+inline uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+inline int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// Append cells [0, count) as (run length, value) pairs.
+inline void putRuns(std::string &out, const int *cells, int count)
+{
+    int i = 0;
+    while (i < count)
+    {
+        int j = i + 1;
+        while (j < count && cells[j] == cells[i])
+            j++;
+        putVarint(out, (uint64_t)(j - i));
+        putVarint(out, zigzag(cells[i]));
+        i = j;
+    }
+}
+
+inline bool getRuns(const uint8_t *&p, const uint8_t *end, int *cells, int count)
+{
+    int i = 0;
+    while (i < count)
+    {
+        uint64_t run, value;
+        if (!getVarint(p, end, run) || !getVarint(p, end, value) || run == 0 || run > (uint64_t)(count - i))
+            return false;
+        int v = (int)unzigzag(value);
+        for (uint64_t k = 0; k < run; k++)
+            cells[i++] = v;
+    }
+    return true;
+}
+
+class Writer
+{
+public:
+    Writer() : out(nullptr), cells(0), keyframeEvery(16), sinceKeyframe(0), records(0), bytes(0) {}
+    ~Writer() { close(); }
+
+    bool open(const std::string &path, int cellCount, int keyframeInterval)
+    {
+        out = std::fopen(path.c_str(), "wb");
+        if (!out)
+            return false;
+        cells = cellCount;
+        keyframeEvery = keyframeInterval < 1 ? 1 : keyframeInterval;
+        sinceKeyframe = 0;
+        previous.assign(cells, 0);
+        std::string header(MAGIC, sizeof(MAGIC));
+        putVarint(header, (uint64_t)cells);
+        emit(header);
+        return true;
+    }
+
+    bool isOpen() const { return out != nullptr; }
+
+    void write(long long cycle, const int *memory)
+    {
+        payload.clear();
+        uint8_t type = (records == 0 || sinceKeyframe + 1 >= keyframeEvery) ? RECORD_KEYFRAME : RECORD_DELTA;
+        if (type == RECORD_KEYFRAME)
+        {
+            putRuns(payload, memory, cells);
+            sinceKeyframe = 0;
+        }
+        else
+        {
+            encodeDelta(memory);
+            sinceKeyframe++;
+        }
+        std::memcpy(previous.data(), memory, (size_t)cells * sizeof(int));
+
+        record.clear();
+        record.push_back((char)type);
+        putVarint(record, (uint64_t)cycle);
+        putVarint(record, payload.size());
+        record += payload;
+        emit(record);
+        records++;
+    }
+
+    void close()
+    {
+        if (out)
+        {
+            std::fclose(out);
+            out = nullptr;
+        }
+    }
+
+    long long recordCount() const { return records; }
+    long long byteCount() const { return bytes; }
+
+private:
+    // Skip equal spans 64 cells at a time before looking at single cells.
+    int nextChange(const int *memory, int i) const
+    {
+        while (i + 64 <= cells && std::memcmp(memory + i, previous.data() + i, 64 * sizeof(int)) == 0)
+            i += 64;
+        while (i < cells && memory[i] == previous[i])
+            i++;
+        return i;
+    }
+
+    void encodeDelta(const int *memory)
+    {
+        int i = 0;
+        while (i < cells)
+        {
+            int changeStart = nextChange(memory, i);
+            int changeEnd = changeStart;
+            while (changeEnd < cells && memory[changeEnd] != previous[changeEnd])
+                changeEnd++;
+            putVarint(payload, (uint64_t)(changeStart - i));
+            putVarint(payload, (uint64_t)(changeEnd - changeStart));
+            putRuns(payload, memory + changeStart, changeEnd - changeStart);
+            i = changeEnd;
+        }
+    }
+
+    void emit(const std::string &data)
+    {
+        std::fwrite(data.data(), 1, data.size(), out);
+        bytes += (long long)data.size();
+    }
+
+    FILE *out;
+    int cells;
+    int keyframeEvery;
+    int sinceKeyframe;
+    long long records;
+    long long bytes;
+    std::vector<int> previous;
+    std::string payload;
+    std::string record;
+};
+
+struct RecordInfo
+{
+    uint8_t type;
+    long long cycle;
+    size_t offset; // payload position in the file
+    size_t length;
+};
+
+class Reader
+{
+public:
+    Reader() : cells(0) {}
+
+    // Load the file and index its records. Returns false on a malformed file.
+    bool open(const std::string &path)
+    {
+        FILE *in = std::fopen(path.c_str(), "rb");
+        if (!in)
+            return false;
+        data.clear();
+        char buf[1 << 16];
+        size_t n;
+        while ((n = std::fread(buf, 1, sizeof(buf), in)) > 0)
+            data.insert(data.end(), buf, buf + n);
+        std::fclose(in);
+
+        if (data.size() < sizeof(MAGIC) || std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0)
+            return false;
+        const uint8_t *p = data.data() + sizeof(MAGIC);
+        const uint8_t *end = data.data() + data.size();
+        uint64_t count;
+        if (!getVarint(p, end, count))
+            return false;
+        cells = (int)count;
+        records.clear();
+        while (p < end)
+        {
+            RecordInfo info;
+            uint64_t cycle, length;
+            info.type = *p++;
+            if (!getVarint(p, end, cycle) || !getVarint(p, end, length) || length > (uint64_t)(end - p))
+                return false;
+            if (info.type != RECORD_KEYFRAME && info.type != RECORD_DELTA)
+                return false;
+            if (records.empty() && info.type != RECORD_KEYFRAME)
+                return false;
+            info.cycle = (long long)cycle;
+            info.offset = (size_t)(p - data.data());
+            info.length = (size_t)length;
+            records.push_back(info);
+            p += length;
+        }
+        return true;
+    }
+
+    int cellCount() const { return cells; }
+    const std::vector<RecordInfo> &index() const { return records; }
+
+    // Rebuild memory as of the last snapshot taken at or before 'cycle'.
+    // Returns that snapshot's position in index(), or -1 if there is none.
+    int stateAt(long long cycle, std::vector<int> &memory) const
+    {
+        int last = -1;
+        for (int i = 0; i < (int)records.size() && records[i].cycle <= cycle; i++)
+            last = i;
+        if (last == -1)
+            return -1;
+        int key = last;
+        while (records[key].type != RECORD_KEYFRAME)
+            key--;
+        memory.assign(cells, 0);
+        for (int i = key; i <= last; i++)
+        {
+            if (!apply(records[i], memory))
+                return -1;
+        }
+        return last;
+    }
+
+private:
+    bool apply(const RecordInfo &info, std::vector<int> &memory) const
+    {
+        const uint8_t *p = data.data() + info.offset;
+        const uint8_t *end = p + info.length;
+        if (info.type == RECORD_KEYFRAME)
+            return getRuns(p, end, memory.data(), cells);
+        int i = 0;
+        while (i < cells)
+        {
+            uint64_t skip, changed;
+            if (!getVarint(p, end, skip) || !getVarint(p, end, changed) ||
+                skip + changed == 0 || skip + changed > (uint64_t)(cells - i))
+                return false;
+            i += (int)skip;
+            if (!getRuns(p, end, memory.data() + i, (int)changed))
+                return false;
+            i += (int)changed;
+        }
+        return true;
+    }
+
+    int cells;
+    std::vector<uint8_t> data;
+    std::vector<RecordInfo> records;
+};
+
+} // namespace snapshot
+
+#endif
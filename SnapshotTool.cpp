@@ -0,0 +1,114 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "Snapshot.h"
+using namespace std;
+
+// -----------------------------------------------------------------------------
+// Snapshot tool
+//
+//   SnapshotTool FILE                 list the snapshots in FILE
+//   SnapshotTool FILE --at=CYCLE      print memory as of CYCLE ("i : value")
+//
+// --from=N and --to=N limit the printed cells; --changed prints only cells
+// that are not -1.
+// -----------------------------------------------------------------------------
+
+void printUsage()
+{
+    cerr << "Usage: SnapshotTool FILE [options]\n"
+         << "  (no options)           list snapshots: index, cycle, type, bytes\n"
+         << "  --at=CYCLE             rebuild memory as of CYCLE and print it\n"
+         << "  --from=N, --to=N       print only cells N.. / ..N\n"
+         << "  --changed              print only cells that are not -1\n";
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printUsage();
+        return 1;
+    }
+    string path = argv[1];
+    bool render = false;
+    bool changedOnly = false;
+    long long cycle = 0;
+    long long from = 0, to = -1;
+
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string name = arg.substr(0, eq);
+        string value = eq == string::npos ? "" : arg.substr(eq + 1);
+        if (name == "--at")
+        {
+            render = true;
+            cycle = atoll(value.c_str());
+        }
+        else if (name == "--from")
+            from = atoll(value.c_str());
+        else if (name == "--to")
+            to = atoll(value.c_str());
+        else if (name == "--changed")
+            changedOnly = true;
+        else
+        {
+            cerr << "Error: bad option " << arg << endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    snapshot::Reader reader;
+    if (!reader.open(path))
+    {
+        cerr << "Error: cannot read snapshot file " << path << endl;
+        return 1;
+    }
+    const vector<snapshot::RecordInfo> &records = reader.index();
+
+    if (!render)
+    {
+        cout << path << ": " << reader.cellCount() << " cells, " << records.size() << " snapshots\n";
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            cout << i << "\tcycle " << records[i].cycle << "\t"
+                 << (records[i].type == snapshot::RECORD_KEYFRAME ? "keyframe" : "delta")
+                 << "\t" << records[i].length << " bytes\n";
+        }
+        return 0;
+    }
+
+    vector<int> memory;
+    int at = reader.stateAt(cycle, memory);
+    if (at < 0)
+    {
+        cerr << "Error: no snapshot at or before cycle " << cycle << endl;
+        return 1;
+    }
+    if (to < 0 || to >= reader.cellCount())
+        to = reader.cellCount() - 1;
+
+    // Same "i : value" lines as the simulator's text dump.
+    string text;
+    char line[48];
+    cerr << "Memory as of snapshot " << at << " (cycle " << records[at].cycle << ")" << endl;
+    for (long long i = from < 0 ? 0 : from; i <= to; i++)
+    {
+        if (changedOnly && memory[i] == -1)
+            continue;
+        int n = snprintf(line, sizeof(line), "%lld : %d\n", i, memory[i]);
+        text.append(line, n);
+        if (text.size() >= (1 << 20))
+        {
+            fwrite(text.data(), 1, text.size(), stdout);
+            text.clear();
+        }
+    }
+    fwrite(text.data(), 1, text.size(), stdout);
+    return 0;
+}
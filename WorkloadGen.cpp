@@ -0,0 +1,140 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "WorkloadGen.h"
+using namespace std;
+
+// -----------------------------------------------------------------------------
+// Workload generator CLI
+//
+//   WorkloadGen [options] > input.txt
+//
+// Every option is --name=value. Distributions are written as
+// fixed:v, uniform:lo:hi, normal:mean:sd or exp:mean.
+// -----------------------------------------------------------------------------
+
+void printUsage()
+{
+    cerr << "Usage: WorkloadGen [options]\n"
+         << "  --seed=N               PRNG seed (default 1)\n"
+         << "  --processes=N          number of processes (default 10)\n"
+         << "  --first-id=N           first process ID (default 1)\n"
+         << "  --max-memory=N         header: physical memory size (default 2048)\n"
+         << "  --quantum=N            header: CPU time slice (default 5)\n"
+         << "  --context-switch=N     header: context switch time (default 2)\n"
+         << "  --mem=DIST             per-process memory size (default uniform:200:500)\n"
+         << "  --instructions=DIST    instructions per process (default uniform:8:20)\n"
+         << "  --mix=c,p,s,l          weights of compute/print/store/load (default 3,1,3,3)\n"
+         << "  --compute=DIST         cycles per compute instruction (default uniform:1:15)\n"
+         << "  --io-burst=DIST        cycles per print (I/O) instruction (default uniform:1:10)\n"
+         << "  --arrival=DIST         inter-arrival gap in cycles; adds @arrival prefixes\n"
+         << "  --burst=N              processes arriving together per gap (default 1)\n"
+         << "  --programs=N           draw processes from N distinct programs (default 0 = all unique)\n"
+         << "  -o PATH, --out=PATH    write to PATH instead of stdout\n";
+}
+
+bool parseMix(const string &value, double mix[4])
+{
+    double parsed[4];
+    if (sscanf(value.c_str(), "%lf,%lf,%lf,%lf", &parsed[0], &parsed[1], &parsed[2], &parsed[3]) != 4)
+        return false;
+    for (int i = 0; i < 4; i++)
+        mix[i] = parsed[i];
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    workload::GeneratorConfig cfg;
+    string outPath;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-h" || arg == "--help")
+        {
+            printUsage();
+            return 0;
+        }
+        if (arg == "-o" && i + 1 < argc)
+        {
+            outPath = argv[++i];
+            continue;
+        }
+        size_t eq = arg.find('=');
+        string name = arg.substr(0, eq);
+        string value = eq == string::npos ? "" : arg.substr(eq + 1);
+        bool ok = true;
+
+        if (name == "--seed")
+            cfg.seed = strtoull(value.c_str(), nullptr, 10);
+        else if (name == "--processes")
+            cfg.numProcesses = atoi(value.c_str());
+        else if (name == "--first-id")
+            cfg.firstProcessID = atoi(value.c_str());
+        else if (name == "--max-memory")
+            cfg.maxMemory = atoi(value.c_str());
+        else if (name == "--quantum")
+            cfg.globalCPUAllocated = atoi(value.c_str());
+        else if (name == "--context-switch")
+            cfg.contextSwitchTime = atoi(value.c_str());
+        else if (name == "--mem")
+            ok = workload::parseDistribution(value, cfg.memorySize);
+        else if (name == "--instructions")
+            ok = workload::parseDistribution(value, cfg.instructionCount);
+        else if (name == "--mix")
+            ok = parseMix(value, cfg.opMix);
+        else if (name == "--compute")
+            ok = workload::parseDistribution(value, cfg.computeCycles);
+        else if (name == "--io-burst")
+            ok = workload::parseDistribution(value, cfg.ioBurst);
+        else if (name == "--arrival")
+        {
+            ok = workload::parseDistribution(value, cfg.interArrival);
+            cfg.arrivals = true;
+        }
+        else if (name == "--burst")
+            cfg.burstSize = atoi(value.c_str());
+        else if (name == "--programs")
+            cfg.distinctPrograms = atoi(value.c_str());
+        else if (name == "--out")
+            outPath = value;
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            cerr << "Error: bad option " << arg << endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    FILE *out = stdout;
+    if (!outPath.empty())
+    {
+        out = fopen(outPath.c_str(), "wb");
+        if (!out)
+        {
+            cerr << "Error: cannot open " << outPath << endl;
+            return 1;
+        }
+    }
+
+    {
+        workload::Generator gen(cfg);
+        workload::TextWriter writer(out);
+        workload::GeneratedProcess proc;
+        writer.writeHeader(cfg);
+        while (!gen.done())
+        {
+            gen.next(proc);
+            writer.writeProcess(proc);
+        }
+    }
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
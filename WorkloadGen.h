@@ -0,0 +1,414 @@
+#ifndef WORKLOAD_GEN_H
+#define WORKLOAD_GEN_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Synthetic Workload Generator
+//
+// Produces processes in the same layout parseProcesses() reads:
+//   header:  maxMemory globalCPUAllocated contextSwitchTime numProcesses
+//   process: [@arrival] processID maxMemoryNeeded numInstructions <opcode operands...>
+// Everything is driven by a private 64-bit PRNG so the same seed yields the
+// same bytes on every compiler and standard library.
+// -----------------------------------------------------------------------------
+
+namespace workload
+{
+
+// splitmix64: tiny, fast and fully specified, unlike std::mt19937 + the
+// implementation-defined std:: distributions.
+struct Rng
+{
+    uint64_t state;
+
+    explicit Rng(uint64_t seed) : state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform integer in [lo, hi].
+    int range(int lo, int hi)
+    {
+        if (hi <= lo)
+            return lo;
+        uint64_t span = (uint64_t)(hi - lo) + 1;
+        return lo + (int)(next() % span);
+    }
+
+    // Uniform double in [0, 1).
+    double unit()
+    {
+        return (double)(next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+};
+
+// A small distribution description parsed from "kind:a:b".
+//   fixed:v            always v
+//   uniform:lo:hi      uniform integer in [lo, hi]
+//   normal:mean:sd     rounded normal, clamped at 1
+//   exp:mean           rounded exponential, clamped at 1
+enum DistKind
+{
+    DIST_FIXED,
+    DIST_UNIFORM,
+    DIST_NORMAL,
+    DIST_EXP
+};
+
+struct Distribution
+{
+    DistKind kind;
+    double a;
+    double b;
+
+    Distribution(DistKind k = DIST_FIXED, double a_ = 1, double b_ = 1) : kind(k), a(a_), b(b_) {}
+
+    int sample(Rng &rng) const
+    {
+        double v = a;
+        switch (kind)
+        {
+        case DIST_FIXED:
+            v = a;
+            break;
+        case DIST_UNIFORM:
+            return rng.range((int)a, (int)b);
+        case DIST_NORMAL:
+        {
+            // Box-Muller; one value per call keeps the stream position simple.
+            double u1 = rng.unit();
+            double u2 = rng.unit();
+            if (u1 < 1e-300)
+                u1 = 1e-300;
+            v = a + b * std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+            break;
+        }
+        case DIST_EXP:
+        {
+            double u = rng.unit();
+            v = -a * std::log(1.0 - u);
+            break;
+        }
+        }
+        int r = (int)(v + 0.5);
+        return r < 1 ? 1 : r;
+    }
+};
+
+inline bool parseDistribution(const std::string &spec, Distribution &out)
+{
+    std::vector<std::string> parts;
+    size_t begin = 0;
+    for (size_t i = 0; i <= spec.size(); i++)
+    {
+        if (i == spec.size() || spec[i] == ':')
+        {
+            parts.push_back(spec.substr(begin, i - begin));
+            begin = i + 1;
+        }
+    }
+    if (parts.empty())
+        return false;
+
+    // A bare number means a fixed value.
+    if (parts.size() == 1)
+    {
+        out = Distribution(DIST_FIXED, std::atof(parts[0].c_str()), 0);
+        return true;
+    }
+    const std::string &kind = parts[0];
+    double a = std::atof(parts[1].c_str());
+    double b = parts.size() > 2 ? std::atof(parts[2].c_str()) : a;
+    if (kind == "fixed")
+        out = Distribution(DIST_FIXED, a, b);
+    else if (kind == "uniform" && parts.size() == 3)
+        out = Distribution(DIST_UNIFORM, a, b);
+    else if (kind == "normal" && parts.size() == 3)
+        out = Distribution(DIST_NORMAL, a, b);
+    else if (kind == "exp")
+        out = Distribution(DIST_EXP, a, b);
+    else
+        return false;
+    return true;
+}
+
+struct GeneratorConfig
+{
+    uint64_t seed = 1;
+    int numProcesses = 10;
+    int firstProcessID = 1;
+
+    // Header fields.
+    int maxMemory = 2048;
+    int globalCPUAllocated = 5;
+    int contextSwitchTime = 2;
+
+    // Per-process shape.
+    Distribution memorySize = Distribution(DIST_UNIFORM, 200, 500);
+    Distribution instructionCount = Distribution(DIST_UNIFORM, 8, 20);
+
+    // Relative weights of opcodes 1-4 (compute, print, store, load).
+    double opMix[4] = {3, 1, 3, 3};
+
+    // Operand shapes.
+    Distribution computeCycles = Distribution(DIST_UNIFORM, 1, 15);
+    Distribution ioBurst = Distribution(DIST_UNIFORM, 1, 10);
+
+    // Arrival pattern. When enabled every process is written with an
+    // "@cycle" prefix; jobs come in groups of burstSize separated by a gap
+    // drawn from interArrival (exp:mean gives a Poisson process).
+    bool arrivals = false;
+    Distribution interArrival = Distribution(DIST_EXP, 20, 0);
+    int burstSize = 1;
+
+    // When > 0, processes run one of this many distinct programs (same
+    // memory size and instructions), picked uniformly; 0 = every process unique.
+    int distinctPrograms = 0;
+};
+
+// Operand count for each opcode, the same table the simulator uses.
+inline int opcodeArity(int opcode)
+{
+    switch (opcode)
+    {
+    case 1:
+        return 2; // compute
+    case 2:
+        return 1; // print
+    case 3:
+        return 2; // store
+    case 4:
+        return 1; // load
+    case 5:
+    case 6:
+    case 7:
+        return 1; // jump, jump if zero, jump if nonzero
+    case 8:
+        return 2; // loop
+    case 9:
+    case 10:
+        return 3; // memset, memcpy
+    default:
+        return 0;
+    }
+}
+
+struct GeneratedProcess
+{
+    int arrivalTime = -1; // -1 when the trace has no arrival times
+    int processID = 0;
+    int maxMemoryNeeded = 0;
+    int numInstructions = 0;
+    std::vector<int> instructions; // opcodes interleaved with operands
+};
+
+// Deterministic per-process generator. Each process is produced from the
+// running stream so generation is strictly sequential and O(1) in memory.
+class Generator
+{
+public:
+    explicit Generator(const GeneratorConfig &cfg) : config(cfg), rng(cfg.seed), produced(0), clock(0)
+    {
+        double total = 0;
+        for (int i = 0; i < 4; i++)
+            total += config.opMix[i] > 0 ? config.opMix[i] : 0;
+        if (total <= 0)
+            total = 1;
+        double acc = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            acc += (config.opMix[i] > 0 ? config.opMix[i] : 0) / total;
+            mixThreshold[i] = acc;
+        }
+        mixThreshold[3] = 1.0;
+    }
+
+    bool done() const { return produced >= config.numProcesses; }
+
+    void next(GeneratedProcess &proc)
+    {
+        proc.arrivalTime = -1;
+        if (config.arrivals)
+        {
+            int burst = config.burstSize < 1 ? 1 : config.burstSize;
+            if (produced > 0 && produced % burst == 0)
+                clock += config.interArrival.sample(rng);
+            proc.arrivalTime = (int)clock;
+        }
+        proc.processID = config.firstProcessID + produced;
+        produced++;
+
+        if (config.distinctPrograms > 0)
+        {
+            if (library.empty())
+                library.resize(config.distinctPrograms);
+            GeneratedProcess &program = library[rng.range(0, config.distinctPrograms - 1)];
+            if (program.numInstructions == 0)
+                generateProgram(program);
+            proc.maxMemoryNeeded = program.maxMemoryNeeded;
+            proc.numInstructions = program.numInstructions;
+            proc.instructions = program.instructions;
+            return;
+        }
+        generateProgram(proc);
+    }
+
+    const GeneratorConfig &cfg() const { return config; }
+
+private:
+    // Fill in memory size and instructions.
+    void generateProgram(GeneratedProcess &proc)
+    {
+        proc.numInstructions = config.instructionCount.sample(rng);
+        proc.instructions.clear();
+
+        // Pick opcodes first so the image size is known before we pick
+        // addresses; store/load targets must stay under maxMemoryNeeded.
+        opcodes.resize(proc.numInstructions);
+        int imageSize = 0;
+        for (int i = 0; i < proc.numInstructions; i++)
+        {
+            opcodes[i] = pickOpcode();
+            imageSize += 1 + opcodeArity(opcodes[i]);
+        }
+        int mem = config.memorySize.sample(rng);
+        proc.maxMemoryNeeded = mem < imageSize ? imageSize : mem;
+
+        for (int i = 0; i < proc.numInstructions; i++)
+        {
+            int op = opcodes[i];
+            proc.instructions.push_back(op);
+            switch (op)
+            {
+            case 1:
+                proc.instructions.push_back(rng.range(1, 10));
+                proc.instructions.push_back(config.computeCycles.sample(rng));
+                break;
+            case 2:
+                proc.instructions.push_back(config.ioBurst.sample(rng));
+                break;
+            case 3:
+                proc.instructions.push_back(rng.range(1, 100));
+                proc.instructions.push_back(rng.range(0, proc.maxMemoryNeeded - 1));
+                break;
+            case 4:
+                proc.instructions.push_back(rng.range(0, proc.maxMemoryNeeded - 1));
+                break;
+            }
+        }
+    }
+
+    int pickOpcode()
+    {
+        double u = rng.unit();
+        for (int i = 0; i < 4; i++)
+        {
+            if (u < mixThreshold[i])
+                return i + 1;
+        }
+        return 4;
+    }
+
+    GeneratorConfig config;
+    Rng rng;
+    int produced;
+    long long clock;
+    double mixThreshold[4];
+    std::vector<int> opcodes;
+    std::vector<GeneratedProcess> library;
+};
+
+// Buffered text writer: formats integers by hand and hands the stdio layer
+// large chunks, which is what makes multi-million-process traces cheap.
+class TextWriter
+{
+public:
+    explicit TextWriter(FILE *f) : out(f) { buffer.reserve(kChunk + 64); }
+    ~TextWriter() { flush(); }
+
+    void putInt(long long v)
+    {
+        char tmp[24];
+        int n = 0;
+        bool neg = v < 0;
+        unsigned long long u = neg ? (unsigned long long)(-v) : (unsigned long long)v;
+        do
+        {
+            tmp[n++] = (char)('0' + u % 10);
+            u /= 10;
+        } while (u);
+        if (neg)
+            buffer.push_back('-');
+        while (n)
+            buffer.push_back(tmp[--n]);
+    }
+
+    void putChar(char c)
+    {
+        buffer.push_back(c);
+        if (buffer.size() >= kChunk)
+            flush();
+    }
+
+    void flush()
+    {
+        if (!buffer.empty())
+        {
+            fwrite(buffer.data(), 1, buffer.size(), out);
+            buffer.clear();
+        }
+    }
+
+    void writeHeader(const GeneratorConfig &cfg)
+    {
+        putInt(cfg.maxMemory);
+        putChar('\n');
+        putInt(cfg.globalCPUAllocated);
+        putChar('\n');
+        putInt(cfg.contextSwitchTime);
+        putChar('\n');
+        putInt(cfg.numProcesses);
+        putChar('\n');
+    }
+
+    void writeProcess(const GeneratedProcess &proc)
+    {
+        if (proc.arrivalTime >= 0)
+        {
+            putChar('@');
+            putInt(proc.arrivalTime);
+            putChar(' ');
+        }
+        putInt(proc.processID);
+        putChar(' ');
+        putInt(proc.maxMemoryNeeded);
+        putChar(' ');
+        putInt(proc.numInstructions);
+        for (size_t i = 0; i < proc.instructions.size(); i++)
+        {
+            putChar(' ');
+            putInt(proc.instructions[i]);
+        }
+        putChar('\n');
+    }
+
+private:
+    static const size_t kChunk = 1 << 20;
+    FILE *out;
+    std::string buffer;
+};
+
+} // namespace workload
+
+#endif